@@ -0,0 +1,112 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "astrolink4_hotplug.h"
+
+#include <eventloop.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define BY_ID_DIR "/dev/serial/by-id"
+
+static const char *const WATCHED_DIRS[] = {"/dev", "/dev/serial", BY_ID_DIR};
+
+std::string PortWatcher::stableLink(const char *port)
+{
+    if (!strncmp(port, BY_ID_DIR "/", strlen(BY_ID_DIR) + 1))
+        return port;
+
+    char device[PATH_MAX], target[PATH_MAX];
+    if (!realpath(port, device))
+        return std::string();
+    DIR *dir = opendir(BY_ID_DIR);
+    if (!dir)
+        return std::string();
+
+    std::string result;
+    while (dirent *entry = readdir(dir))
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        std::string candidate = std::string(BY_ID_DIR "/") + entry->d_name;
+        if (realpath(candidate.c_str(), target) && !strcmp(target, device))
+        {
+            result = candidate;
+            break;
+        }
+    }
+    closedir(dir);
+    return result;
+}
+
+bool PortWatcher::start(const std::string &path, std::string &error)
+{
+    stop();
+    inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFD < 0)
+    {
+        error = strerror(errno);
+        return false;
+    }
+    link = path;
+    arm();
+    present = access(link.c_str(), F_OK) == 0;
+    callback = IEAddCallback(inotifyFD, onEvent, this);
+    return true;
+}
+
+void PortWatcher::stop()
+{
+    if (inotifyFD < 0)
+        return;
+    IERmCallback(callback);
+    ::close(inotifyFD);
+    inotifyFD = -1;
+    callback = -1;
+}
+
+void PortWatcher::arm()
+{
+    // adding a watch again is harmless, directories that do not exist yet are retried on the next event
+    for (const char *dir : WATCHED_DIRS)
+        inotify_add_watch(inotifyFD, dir, IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM | IN_ONLYDIR);
+}
+
+void PortWatcher::onEvent(int fd, void *userpointer)
+{
+    PortWatcher *watcher = static_cast<PortWatcher *>(userpointer);
+
+    // only the state after the whole burst matters, not the single events
+    alignas(inotify_event) char buffer[4096];
+    while (read(fd, buffer, sizeof(buffer)) > 0)
+        ;
+
+    watcher->arm();
+    // access() follows the link, so a link to a node that is not there yet counts as absent
+    bool present = access(watcher->link.c_str(), F_OK) == 0;
+    if (present == watcher->present)
+        return;
+    watcher->present = present;
+    watcher->listener(present);
+}
@@ -0,0 +1,66 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#ifndef ASTROLINK4_HOTPLUG_H
+#define ASTROLINK4_HOTPLUG_H
+
+#include <functional>
+#include <string>
+
+// Watches a /dev/serial/by-id link with inotify in the driver event loop.
+// udev removes the link together with the tty and creates it again, pointing
+// to the new node, when the adapter comes back. The by-id directories
+// themselves come and go with the last serial device, so their parents are
+// watched as well.
+class PortWatcher
+{
+public:
+    typedef std::function<void(bool present)> Listener;
+
+    explicit PortWatcher(Listener listener) : listener(listener) {}
+    ~PortWatcher()
+    {
+        stop();
+    }
+
+    bool start(const std::string &path, std::string &error);
+    void stop();
+    bool isWatching() const
+    {
+        return inotifyFD >= 0;
+    }
+    const std::string &path() const
+    {
+        return link;
+    }
+
+    // the by-id link of the device behind port, empty when there is none
+    static std::string stableLink(const char *port);
+
+private:
+    Listener listener;
+    std::string link;
+    int inotifyFD{-1};
+    int callback{-1};
+    bool present{false};
+
+    void arm();
+    static void onEvent(int fd, void *userpointer);
+};
+
+#endif
@@ -0,0 +1,272 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "astrolink4_metrics.h"
+
+#include <eventloop.h>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define METRICS_SEND_TIMEOUT 100
+
+//////////////////////////////////////////////////////////////////////
+/// MetricsWriter
+//////////////////////////////////////////////////////////////////////
+void MetricsWriter::append(const char *format, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (n > 0)
+        out.append(line, std::min<size_t>(n, sizeof(line) - 1));
+}
+
+void MetricsWriter::family(const char *name, const char *type, const char *unit, const char *help)
+{
+    counter = !strcmp(type, "counter");
+    append("# TYPE %s %s\n", name, type);
+    if (unit)
+        append("# UNIT %s %s\n", name, unit);
+    append("# HELP %s %s\n", name, help);
+}
+
+void MetricsWriter::sample(const char *name, double value)
+{
+    append("%s%s %.10g\n", name, counter ? "_total" : "", value);
+}
+
+void MetricsWriter::sample(const char *name, const char *label, const char *labelValue, double value)
+{
+    append("%s%s{%s=\"%s\"} %.10g\n", name, counter ? "_total" : "", label, labelValue, value);
+}
+
+void MetricsWriter::finish()
+{
+    out.append("# EOF\n");
+}
+
+//////////////////////////////////////////////////////////////////////
+/// MetricsExporter
+//////////////////////////////////////////////////////////////////////
+bool MetricsExporter::start(const char *endpoint, std::string &error)
+{
+    stop();
+
+    int fd = -1;
+    if (!strncmp(endpoint, "unix:", 5))
+    {
+        const char *path = endpoint + 5;
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        if (!*path || strlen(path) >= sizeof(address.sun_path))
+        {
+            error = "invalid socket path";
+            return false;
+        }
+        strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+        // a socket left behind by an earlier run is replaced, any other file is not
+        struct stat info;
+        if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode))
+            unlink(path);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+        {
+            error = strerror(errno);
+            if (fd >= 0)
+                ::close(fd);
+            return false;
+        }
+        socketPath = path;
+    }
+    else if (!strncmp(endpoint, "tcp:", 4))
+    {
+        char *end = nullptr;
+        long port = strtol(endpoint + 4, &end, 10);
+        if (end == endpoint + 4 || *end != '\0' || port <= 0 || port > 65535)
+        {
+            error = "invalid port";
+            return false;
+        }
+        // never exposed beyond the local host
+        sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int reuse = 1;
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd >= 0)
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+        {
+            error = strerror(errno);
+            if (fd >= 0)
+                ::close(fd);
+            return false;
+        }
+    }
+    else
+    {
+        error = "endpoint must be unix:<path> or tcp:<port>";
+        return false;
+    }
+
+    if (listen(fd, MAX_CLIENTS) < 0)
+    {
+        error = strerror(errno);
+        ::close(fd);
+        if (!socketPath.empty())
+            unlink(socketPath.c_str());
+        socketPath.clear();
+        return false;
+    }
+    listenFD = fd;
+    listenCallback = IEAddCallback(listenFD, onAccept, this);
+    return true;
+}
+
+void MetricsExporter::stop()
+{
+    while (!clients.empty())
+        close(clients.front());
+    if (listenFD < 0)
+        return;
+
+    IERmCallback(listenCallback);
+    ::close(listenFD);
+    listenFD = -1;
+    listenCallback = -1;
+    if (!socketPath.empty())
+        unlink(socketPath.c_str());
+    socketPath.clear();
+}
+
+void MetricsExporter::onAccept(int fd, void *userpointer)
+{
+    MetricsExporter *exporter = static_cast<MetricsExporter *>(userpointer);
+    int clientFD = accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (clientFD < 0)
+        return;
+
+    // a scraper that never sends a request must not hold a slot forever
+    if (exporter->clients.size() >= MAX_CLIENTS)
+        exporter->close(exporter->clients.front());
+    exporter->clients.push_back({exporter, clientFD, -1, std::string()});
+    Client &client = exporter->clients.back();
+    client.callback = IEAddCallback(clientFD, onClient, &client);
+}
+
+void MetricsExporter::onClient(int fd, void *userpointer)
+{
+    Client &client = *static_cast<Client *>(userpointer);
+    MetricsExporter *exporter = client.owner;
+
+    char buffer[512];
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            exporter->close(client);
+        return;
+    }
+    if (n == 0)
+    {
+        exporter->respond(client, false);
+        return;
+    }
+
+    client.request.append(buffer, n);
+    if (client.request.size() > MAX_REQUEST)
+    {
+        exporter->close(client);
+        return;
+    }
+    if (client.request.find('\n') == std::string::npos)
+        return;
+    if (client.request.compare(0, 4, "GET ") != 0)
+        exporter->respond(client, false);
+    else if (client.request.find("\r\n\r\n") != std::string::npos || client.request.find("\n\n") != std::string::npos)
+        exporter->respond(client, true);
+}
+
+void MetricsExporter::respond(Client &client, bool http)
+{
+    std::string body;
+    render(body);
+    scrapeCount++;
+
+    std::string response;
+    if (http)
+    {
+        char header[256];
+        snprintf(header, sizeof(header),
+                 "HTTP/1.0 200 OK\r\n"
+                 "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                 "Content-Length: %zu\r\n"
+                 "Connection: close\r\n\r\n", body.size());
+        response = header;
+    }
+    response += body;
+
+    // the reply normally fits the socket buffer, a stalled reader is dropped
+    size_t sent = 0;
+    while (sent < response.size())
+    {
+        ssize_t n = send(client.fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            sent += n;
+            continue;
+        }
+        pollfd pfd = {client.fd, POLLOUT, 0};
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && poll(&pfd, 1, METRICS_SEND_TIMEOUT) > 0)
+            continue;
+        break;
+    }
+    close(client);
+}
+
+void MetricsExporter::close(Client &client)
+{
+    IERmCallback(client.callback);
+    ::close(client.fd);
+    for (auto it = clients.begin(); it != clients.end(); ++it)
+    {
+        if (&*it == &client)
+        {
+            clients.erase(it);
+            break;
+        }
+    }
+}
@@ -0,0 +1,96 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#ifndef ASTROLINK4_METRICS_H
+#define ASTROLINK4_METRICS_H
+
+#include <functional>
+#include <list>
+#include <string>
+
+// Appends metric families in the OpenMetrics text format
+class MetricsWriter
+{
+public:
+    explicit MetricsWriter(std::string &out) : out(out) {}
+
+    // unit may be nullptr, counters get the _total suffix on their samples
+    void family(const char *name, const char *type, const char *unit, const char *help);
+    void sample(const char *name, double value);
+    void sample(const char *name, const char *label, const char *labelValue, double value);
+    void finish();
+
+private:
+    std::string &out;
+    bool counter{false};
+    void append(const char *format, ...);
+};
+
+// Serves the rendered metrics to scrapers on a Unix socket or a localhost
+// port. Runs in the driver event loop, the renderer must not block.
+// Plain HTTP GET requests are answered with a HTTP response, other clients
+// get the bare exposition after sending a line or closing their sending side.
+class MetricsExporter
+{
+public:
+    typedef std::function<void(std::string &out)> Renderer;
+
+    explicit MetricsExporter(Renderer render) : render(render) {}
+    ~MetricsExporter()
+    {
+        stop();
+    }
+
+    // endpoint is "unix:<path>" or "tcp:<port>"
+    bool start(const char *endpoint, std::string &error);
+    void stop();
+    bool isRunning() const
+    {
+        return listenFD >= 0;
+    }
+    unsigned long scrapes() const
+    {
+        return scrapeCount;
+    }
+
+private:
+    static constexpr size_t MAX_CLIENTS = 8;
+    static constexpr size_t MAX_REQUEST = 4096;
+
+    struct Client
+    {
+        MetricsExporter *owner;
+        int fd;
+        int callback;
+        std::string request;
+    };
+
+    Renderer render;
+    int listenFD{-1};
+    int listenCallback{-1};
+    std::string socketPath;
+    std::list<Client> clients;
+    unsigned long scrapeCount{0};
+
+    static void onAccept(int fd, void *userpointer);
+    static void onClient(int fd, void *userpointer);
+    void respond(Client &client, bool http);
+    void close(Client &client);
+};
+
+#endif
@@ -0,0 +1,109 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "astrolink4_profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+void FocuserMotionProfiler::begin(int focuser, double timestamp, int position, int target)
+{
+    current = Move{focuser, timestamp, position, target, 0, position, 0, 0, 0, {}};
+    current.trace.push_back({timestamp, position, std::abs(target - position)});
+    active = true;
+}
+
+bool FocuserMotionProfiler::sample(double timestamp, int position, int stepsToGo)
+{
+    if (!active)
+        return false;
+
+    const Sample &previous = current.trace.back();
+    double dt = timestamp - previous.t;
+    if (dt > 0)
+        current.peakPps = std::max(current.peakPps, std::abs(position - previous.position) / dt);
+    if (current.trace.size() < MAX_TRACE)
+        current.trace.push_back({timestamp, position, stepsToGo});
+
+    // travel past the target in the direction of the move
+    int direction = (current.target >= current.startPosition) ? 1 : -1;
+    current.overshoot = std::max(current.overshoot, (position - current.target) * direction);
+
+    if (stepsToGo != 0)
+        return false;
+
+    current.duration = timestamp - current.start;
+    current.endPosition = position;
+    if (current.duration > 0)
+        current.averagePps = std::abs(position - current.startPosition) / current.duration;
+    moves.push_back(std::move(current));
+    if (moves.size() > MAX_MOVES)
+        moves.pop_front();
+    active = false;
+    return true;
+}
+
+void FocuserMotionProfiler::cancel()
+{
+    active = false;
+}
+
+void FocuserMotionProfiler::clear()
+{
+    moves.clear();
+    active = false;
+}
+
+FocuserMotionProfiler::Summary FocuserMotionProfiler::summary() const
+{
+    Summary result{moves.size(), 0, 0, 0, 0};
+    if (moves.empty())
+        return result;
+
+    for (const auto &move : moves)
+    {
+        result.averagePps += move.averagePps;
+        result.averageDuration += move.duration;
+        result.peakPps = std::max(result.peakPps, move.peakPps);
+        result.maxOvershoot = std::max(result.maxOvershoot, move.overshoot);
+    }
+    result.averagePps /= moves.size();
+    result.averageDuration /= moves.size();
+    return result;
+}
+
+bool FocuserMotionProfiler::exportLog(const char *path) const
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return false;
+
+    // one M record per move followed by its S trace records
+    fprintf(fp, "record,move,focuser,t,position,steps_to_go,target,duration,average_pps,peak_pps,overshoot\n");
+    size_t id = 0;
+    for (const auto &move : moves)
+    {
+        fprintf(fp, "M,%zu,%d,0.000,%d,%d,%d,%.3f,%.1f,%.1f,%d\n", id, move.focuser + 1, move.startPosition,
+                std::abs(move.target - move.startPosition), move.target, move.duration, move.averagePps, move.peakPps, move.overshoot);
+        for (const auto &sample : move.trace)
+            fprintf(fp, "S,%zu,%d,%.3f,%d,%d,,,,,\n", id, move.focuser + 1, sample.t - move.start, sample.position, sample.stepsToGo);
+        id++;
+    }
+    return fclose(fp) == 0;
+}
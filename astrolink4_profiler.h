@@ -0,0 +1,91 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+
+#ifndef ASTROLINK4_PROFILER_H
+#define ASTROLINK4_PROFILER_H
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// Records focuser moves from the telemetry stream. A move starts with the
+// move command and completes on the first sample with no steps to go.
+class FocuserMotionProfiler
+{
+public:
+    struct Sample
+    {
+        double t;
+        int position;
+        int stepsToGo;
+    };
+
+    struct Move
+    {
+        int focuser;
+        double start;
+        int startPosition;
+        int target;
+        double duration;
+        int endPosition;
+        double averagePps;
+        double peakPps;
+        int overshoot;
+        std::vector<Sample> trace;
+    };
+
+    struct Summary
+    {
+        size_t moves;
+        double averagePps;
+        double peakPps;
+        double averageDuration;
+        int maxOvershoot;
+    };
+
+    void begin(int focuser, double timestamp, int position, int target);
+    // returns true when the sample completes the tracked move
+    bool sample(double timestamp, int position, int stepsToGo);
+    void cancel();
+    void clear();
+
+    bool isActive() const
+    {
+        return active;
+    }
+    bool hasMoves() const
+    {
+        return !moves.empty();
+    }
+    const Move &lastMove() const
+    {
+        return moves.back();
+    }
+    Summary summary() const;
+    bool exportLog(const char *path) const;
+
+private:
+    static constexpr size_t MAX_MOVES = 200;
+    static constexpr size_t MAX_TRACE = 2000;
+    std::deque<Move> moves;
+    Move current;
+    bool active{false};
+};
+
+#endif
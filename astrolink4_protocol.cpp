@@ -0,0 +1,109 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "astrolink4_protocol.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int tokenizeFrame(char *frame, const char *fields[], int maxFields)
+{
+    int count = 0;
+    char *field = frame;
+    while (count < maxFields)
+    {
+        fields[count++] = field;
+        char *separator = strchr(field, ':');
+        if (!separator)
+            break;
+        *separator = '\0';
+        field = separator + 1;
+    }
+    return count;
+}
+
+bool parseField(const char *field, double &value)
+{
+    char *end = nullptr;
+    value = strtod(field, &end);
+    return end != field && *end == '\0';
+}
+
+void SettingsUpdate::set(const FieldDescriptor &field, int focuser, double value)
+{
+    value = std::min(std::max(value, field.min), field.max) * field.scale;
+    long raw = (field.type == FIELD_ROUND) ? std::lround(value) : static_cast<long>(value);
+    setRaw(field.index[focuser], raw);
+}
+
+void SettingsUpdate::setRaw(int index, long value)
+{
+    Entry *entry = std::find_if(entries, entries + count, [index](const Entry & e)
+    {
+        return e.index == index;
+    });
+    if (entry == entries + count)
+    {
+        if (count == U_FIELD_COUNT)
+            return;
+        count++;
+    }
+    entry->index = index;
+    snprintf(entry->text, sizeof(entry->text), "%ld", value);
+}
+
+void SettingsUpdate::merge(const SettingsUpdate &other)
+{
+    for (size_t i = 0; i < other.count; i++)
+    {
+        Entry *entry = std::find_if(entries, entries + count, [&other, i](const Entry & e)
+        {
+            return e.index == other.entries[i].index;
+        });
+        if (entry == entries + count)
+        {
+            if (count == U_FIELD_COUNT)
+                return;
+            count++;
+        }
+        *entry = other.entries[i];
+    }
+}
+
+bool SettingsUpdate::build(const char *current, char *frame, size_t len) const
+{
+    char buffer[256];
+    const char *fields[U_FIELD_COUNT];
+    snprintf(buffer, sizeof(buffer), "%s", current);
+    int n = tokenizeFrame(buffer, fields, U_FIELD_COUNT);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (entries[i].index >= n)
+            return false;
+        fields[entries[i].index] = entries[i].text;
+    }
+
+    // same layout as the 'u' reply, every field followed by a separator
+    size_t used = snprintf(frame, len, "U:");
+    for (int i = 1; i < n && used < len; i++)
+        used += snprintf(frame + used, len - used, "%s:", fields[i]);
+    return used < len;
+}
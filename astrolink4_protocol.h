@@ -0,0 +1,235 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+
+#ifndef ASTROLINK4_PROTOCOL_H
+#define ASTROLINK4_PROTOCOL_H
+
+#include <cstddef>
+
+// longest frame exchanged with the controller, terminator included
+#define ASTROLINK4_LEN 250
+
+#define Q_DEVICE_CODE 0
+#define Q_FOC1_POS 1
+#define Q_FOC1_TO_GO 2
+#define Q_FOC2_POS 3
+#define Q_FOC2_TO_GO 4
+#define Q_ITOT 5
+#define Q_SENS1_PRESENT 6
+#define Q_SENS1_TEMP 7
+#define Q_SENS1_HUM 8
+#define Q_SENS1_DEW 9
+#define Q_SENS2_PRESENT 10
+#define Q_SENS2_TEMP 11
+#define Q_PWM1 12
+#define Q_PWM2 13
+#define Q_OUT1 14
+#define Q_OUT2 15
+#define Q_OUT3 16
+#define Q_VIN 17
+#define Q_VREG 18
+#define Q_AH 19
+#define Q_WH 20
+#define Q_FOC1_COMP 21
+#define Q_FOC2_COMP 22
+#define Q_OVERTYPE 23
+#define Q_OVERVALUE 24
+#define Q_MLX_PRESENT 25
+#define Q_MLX_TEMP 26
+#define Q_MLX_AUX 27
+#define Q_SENS2E_PRESENT 28
+#define Q_SENS2E_TEMP 29
+#define Q_SENS2E_HUM 30
+#define Q_SENS2E_DEW 31
+#define Q_SBM_PRESENT 32
+#define Q_SBM 33
+
+#define U_BUZZER 1
+#define U_MANUAL 2
+#define U_FOC1_CUR 3
+#define U_FOC2_CUR 4
+#define U_FOC1_HOLD 5
+#define U_FOC2_HOLD 6
+#define U_FOC1_SPEED 7
+#define U_FOC2_SPEED 8
+#define U_FOC1_ACC 9
+#define U_FOC2_ACC 10
+#define U_FOC1_MODE 11
+#define U_FOC2_MODE 12
+#define U_FOC1_MAX 13
+#define U_FOC2_MAX 14
+#define U_FOC1_REV 15
+#define U_FOC2_REV 16
+#define U_FOC1_STEP 17
+#define U_FOC2_STEP 18
+#define U_FOC1_COMPSTEPS 19
+#define U_FOC2_COMPSTEPS 20
+#define U_FOC_COMP_CYCLE 21
+#define U_FOC1_COMPTRIGGER 22
+#define U_FOC2_COMPTRIGGER 23
+#define U_FOC1_COMPAUTO 24
+#define U_FOC2_COMPAUTO 25
+#define U_PWM_PRESC 26
+#define U_OUT1_DEF 27
+#define U_OUT2_DEF 28
+#define U_OUT3_DEF 29
+#define U_PWM1_DEF 30
+#define U_PWM2_DEF 31
+#define U_HUM_SENSOR 32
+#define U_HUM_START 33
+#define U_HUM_FULL 34
+#define U_TEMP_PRESET 35
+#define U_VREF 36
+#define U_OVERVOLTAGE 37
+#define U_OVERCURRENT 38
+#define U_OVERTIME 39
+#define U_COMPSENSOR 40
+#define U_FIELD_COUNT 41
+
+// Encoding of one 'u'/'U' settings field. The device value is the property
+// value multiplied by scale; both directions use the same descriptor.
+enum FieldType
+{
+    FIELD_TRUNCATE,
+    FIELD_ROUND
+};
+
+struct FieldDescriptor
+{
+    int index[2];   // U_* index for focuser 1 and focuser 2
+    int element;    // property element the field is bound to
+    double scale;
+    FieldType type;
+    double min, max;
+    bool decoded;   // false for fields derived from another element
+};
+
+// Focuser settings property elements
+enum
+{
+    FS_SPEED,
+    FS_CURRENT,
+    FS_HOLD,
+    FS_STEP_SIZE,
+    FS_COMPENSATION,
+    FS_COMP_THRESHOLD,
+    FS_COUNT
+};
+
+constexpr FieldDescriptor FOCUSER_SETTINGS_FIELDS[] =
+{
+    {{U_FOC1_SPEED, U_FOC2_SPEED}, FS_SPEED, 1.0, FIELD_TRUNCATE, 10, 200, true},
+    // acceleration follows the speed
+    {{U_FOC1_ACC, U_FOC2_ACC}, FS_SPEED, 5.0, FIELD_TRUNCATE, 10, 200, false},
+    {{U_FOC1_CUR, U_FOC2_CUR}, FS_CURRENT, 0.1, FIELD_TRUNCATE, 100, 2000, true},
+    {{U_FOC1_HOLD, U_FOC2_HOLD}, FS_HOLD, 1.0, FIELD_TRUNCATE, 0, 100, true},
+    {{U_FOC1_STEP, U_FOC2_STEP}, FS_STEP_SIZE, 100.0, FIELD_ROUND, 0, 100, true},
+    {{U_FOC1_COMPSTEPS, U_FOC2_COMPSTEPS}, FS_COMPENSATION, 100.0, FIELD_ROUND, -1000, 1000, true},
+    {{U_FOC1_COMPTRIGGER, U_FOC2_COMPTRIGGER}, FS_COMP_THRESHOLD, 1.0, FIELD_ROUND, 1, 1000, true},
+};
+
+constexpr FieldDescriptor FOCUSER_MODE_FIELD{{U_FOC1_MODE, U_FOC2_MODE}, 0, 1.0, FIELD_TRUNCATE, 0, 2, true};
+constexpr FieldDescriptor FOCUSER_MAX_FIELD{{U_FOC1_MAX, U_FOC2_MAX}, 0, 1.0, FIELD_TRUNCATE, 0, 10000000, true};
+constexpr FieldDescriptor FOCUSER_REVERSE_FIELD{{U_FOC1_REV, U_FOC2_REV}, 0, 1.0, FIELD_TRUNCATE, 0, 1, true};
+
+// Protection property elements
+enum
+{
+    PROT_FIELD_OVERVOLTAGE,
+    PROT_FIELD_OVERCURRENT,
+    PROT_FIELD_OVERTIME,
+    PROT_FIELD_COUNT
+};
+
+constexpr FieldDescriptor PROTECTION_FIELDS[] =
+{
+    {{U_OVERVOLTAGE, U_OVERVOLTAGE}, PROT_FIELD_OVERVOLTAGE, 1000.0, FIELD_TRUNCATE, 10, 16, true},
+    {{U_OVERCURRENT, U_OVERCURRENT}, PROT_FIELD_OVERCURRENT, 1000.0, FIELD_TRUNCATE, 1, 15, true},
+    {{U_OVERTIME, U_OVERTIME}, PROT_FIELD_OVERTIME, 1.0, FIELD_TRUNCATE, 10, 1000, true},
+};
+
+// Splits a ':' separated frame in place, returns the number of fields
+int tokenizeFrame(char *frame, const char *fields[], int maxFields);
+
+// Parses a whole field as a number, false on empty or trailing garbage
+bool parseField(const char *field, double &value);
+
+// Field values of one 'U' write, formatted into fixed buffers
+class SettingsUpdate
+{
+public:
+    void set(const FieldDescriptor &field, int focuser, double value);
+    void setRaw(int index, long value);
+    // entries of other override the ones of the same field
+    void merge(const SettingsUpdate &other);
+    void clear()
+    {
+        count = 0;
+    }
+    size_t size() const
+    {
+        return count;
+    }
+    // builds the 'U' frame from the current 'u' reply
+    bool build(const char *current, char *frame, size_t len) const;
+
+private:
+    struct Entry
+    {
+        int index;
+        char text[16];
+    };
+    Entry entries[U_FIELD_COUNT];
+    size_t count{0};
+};
+
+// Encoders and decoders of the per focuser settings, F is the focuser index
+template <int F>
+struct FocuserFields
+{
+    static_assert(F == 0 || F == 1, "AstroLink 4 mini II has two focusers");
+
+    static constexpr int index(const FieldDescriptor &field)
+    {
+        return field.index[F];
+    }
+
+    static void encode(SettingsUpdate &update, const double values[])
+    {
+        for (const auto &field : FOCUSER_SETTINGS_FIELDS)
+            update.set(field, F, values[field.element]);
+    }
+
+    // values[] receives the property values, returns false on a malformed field
+    static bool decode(const char *const fields[], int count, double values[])
+    {
+        for (const auto &field : FOCUSER_SETTINGS_FIELDS)
+        {
+            double raw;
+            if (!field.decoded)
+                continue;
+            if (index(field) >= count || !parseField(fields[index(field)], raw))
+                return false;
+            values[field.element] = raw / field.scale;
+        }
+        return true;
+    }
+};
+
+#endif
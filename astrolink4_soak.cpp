@@ -0,0 +1,160 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "astrolink4_soak.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// memory growth below this is allocator noise, not a leak
+#define SOAK_RSS_SLACK 512.0
+// latency differences below this are timer resolution
+#define SOAK_LATENCY_SLACK 0.05
+
+//////////////////////////////////////////////////////////////////////
+/// Process resources
+//////////////////////////////////////////////////////////////////////
+double SoakRecorder::cpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+double SoakRecorder::residentKB()
+{
+    long pages = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024.0);
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Recording
+//////////////////////////////////////////////////////////////////////
+void SoakRecorder::begin(size_t cycles)
+{
+    planned = cycles;
+    // reserved up front, so the recorder itself does not show up as growth
+    latencies.clear();
+    latencies.reserve(cycles);
+    cpuStart = cpuFirstQuarter = cpuLastQuarter = cpuEnd = cpuSeconds();
+    rssWarm = rssEnd = residentKB();
+}
+
+void SoakRecorder::addCycle(double latencyMs)
+{
+    if (isComplete())
+        return;
+    latencies.push_back(static_cast<float>(latencyMs));
+
+    size_t n = latencies.size();
+    if (n == planned / 10)
+        rssWarm = residentKB();
+    if (n == planned / 4)
+        cpuFirstQuarter = cpuSeconds();
+    if (n == planned - planned / 4)
+        cpuLastQuarter = cpuSeconds();
+    if (n == planned)
+    {
+        cpuEnd = cpuSeconds();
+        rssEnd = residentKB();
+    }
+}
+
+SoakRecorder::Result SoakRecorder::result() const
+{
+    Result result {};
+    result.cycles = latencies.size();
+    if (latencies.empty())
+        return result;
+
+    size_t quarter = std::max<size_t>(planned / 4, 1);
+    double first = (cpuFirstQuarter - cpuStart) / quarter;
+    double last = (cpuEnd - cpuLastQuarter) / quarter;
+    result.cpuPerCycle = (cpuEnd - cpuStart) * 1000.0 / latencies.size();
+    result.cpuDrift = (first > 0) ? (last - first) / first * 100.0 : 0;
+    result.rssWarm = rssWarm;
+    result.rssEnd = rssEnd;
+    result.rssGrowth = rssEnd - rssWarm;
+
+    std::vector<float> sorted(latencies);
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](double p)
+    {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+    };
+    result.p50 = percentile(0.50);
+    result.p95 = percentile(0.95);
+    result.p99 = percentile(0.99);
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Baseline
+//////////////////////////////////////////////////////////////////////
+std::string SoakRecorder::formatBaseline(const Result &result)
+{
+    char text[256];
+    snprintf(text, sizeof(text), "cpu=%.4f;rss=%.0f;p50=%.4f;p95=%.4f;p99=%.4f;",
+             result.cpuPerCycle, result.rssGrowth, result.p50, result.p95, result.p99);
+    return text;
+}
+
+bool SoakRecorder::parseBaseline(const char *text, Result &baseline)
+{
+    baseline = Result {};
+    return sscanf(text, "cpu=%lf;rss=%lf;p50=%lf;p95=%lf;p99=%lf;", &baseline.cpuPerCycle, &baseline.rssGrowth,
+                  &baseline.p50, &baseline.p95, &baseline.p99) == 5;
+}
+
+bool SoakRecorder::compare(const Result &result, const Result &baseline, double tolerance, std::string &report)
+{
+    char line[128];
+    double limit = 1.0 + tolerance / 100.0;
+    report.clear();
+    if (result.cpuPerCycle > baseline.cpuPerCycle * limit)
+    {
+        snprintf(line, sizeof(line), "CPU %.3f ms/cycle (baseline %.3f); ", result.cpuPerCycle, baseline.cpuPerCycle);
+        report += line;
+    }
+    if (result.rssGrowth > std::max(baseline.rssGrowth, 0.0) * limit + SOAK_RSS_SLACK)
+    {
+        snprintf(line, sizeof(line), "RSS growth %.0f kB (baseline %.0f); ", result.rssGrowth, baseline.rssGrowth);
+        report += line;
+    }
+    const double values[3] = {result.p50, result.p95, result.p99};
+    const double limits[3] = {baseline.p50, baseline.p95, baseline.p99};
+    const char *names[3] = {"p50", "p95", "p99"};
+    for (int i = 0; i < 3; i++)
+    {
+        if (values[i] > limits[i] * limit + SOAK_LATENCY_SLACK)
+        {
+            snprintf(line, sizeof(line), "%s latency %.3f ms (baseline %.3f); ", names[i], values[i], limits[i]);
+            report += line;
+        }
+    }
+    return report.empty();
+}
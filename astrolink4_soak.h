@@ -0,0 +1,73 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#ifndef ASTROLINK4_SOAK_H
+#define ASTROLINK4_SOAK_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Resource usage of a long run of poll cycles, see astrolink4_soak_main.cpp.
+// Memory is taken after a warm up, when every bounded buffer is full, so
+// growth from there on is a leak. CPU drift compares the first and the last
+// quarter of the run.
+class SoakRecorder
+{
+public:
+    struct Result
+    {
+        size_t cycles;
+        double cpuPerCycle;     // ms
+        double cpuDrift;        // %
+        double rssWarm;         // kB
+        double rssEnd;          // kB
+        double rssGrowth;       // kB
+        double p50, p95, p99;   // ms
+    };
+
+    void begin(size_t cycles);
+    // latency is the round trip of the status query of one poll cycle
+    void addCycle(double latencyMs);
+    bool isComplete() const
+    {
+        return latencies.size() >= planned;
+    }
+    size_t cycles() const
+    {
+        return latencies.size();
+    }
+    Result result() const;
+
+    // baseline as "key=value;" pairs, stored in a file between runs
+    static std::string formatBaseline(const Result &result);
+    static bool parseBaseline(const char *text, Result &baseline);
+    // returns false and describes every regression beyond the tolerance
+    static bool compare(const Result &result, const Result &baseline, double tolerance, std::string &report);
+
+    static double cpuSeconds();
+    static double residentKB();
+
+private:
+    size_t planned{0};
+    std::vector<float> latencies;
+    double cpuStart{0}, cpuFirstQuarter{0}, cpuLastQuarter{0}, cpuEnd{0};
+    double rssWarm{0}, rssEnd{0};
+};
+
+#endif
@@ -0,0 +1,322 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+// Accelerated-time soak run of the driver against the loopback controller.
+// The driver runs in simulation mode and its poll loop is ticked on a virtual
+// clock as fast as the host allows, with a scripted workload going through the
+// property handlers. The resource usage is compared with a stored baseline.
+// Not part of the driver, see CMakeLists.txt.
+
+#include "indi_astrolink4mini2.h"
+#include "astrolink4_soak.h"
+
+#include "indicom.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+#define POLLTIME 500
+
+extern std::unique_ptr<IndiAstroLink4mini2> indiFocuserLink;
+
+// the accelerated clock, linked in place of astrolink4_clock.cpp
+static double soakClock = 0;
+
+double monotonicNow()
+{
+    return soakClock;
+}
+
+static double realNow()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Loopback controller that times the round trip of every status query the
+// driver makes and cuts every interval-th reply short, as if bytes were lost
+// on the line
+class SoakLoopback : public LoopbackTransport
+{
+public:
+    SoakLoopback(SoakRecorder &recorder, uint64_t interval) : LoopbackTransport(monotonicNow), recorder(recorder),
+        interval(interval) {}
+
+protected:
+    int write(const char *data, int len) override
+    {
+        if (data[0] == 'q')
+            queryStart = realNow();
+        return LoopbackTransport::write(data, len);
+    }
+
+    int readLine(char *res, int len, int timeoutMs, int *nbytes) override
+    {
+        int rc = LoopbackTransport::readLine(res, len, timeoutMs, nbytes);
+        if (rc != TTY_OK || res[0] != 'q')
+            return rc;
+        recorder.addCycle((realNow() - queryStart) * 1000.0);
+        if (interval > 0 && ++replies % interval == 0)
+        {
+            int cut = *nbytes / 2;
+            snprintf(res + cut, len - cut, "#\n");
+            *nbytes = cut + 2;
+        }
+        return rc;
+    }
+
+private:
+    SoakRecorder &recorder;
+    uint64_t interval;
+    uint64_t replies{0};
+    double queryStart{0};
+};
+
+// Stands in for the event loop: every tick of the driver's poll timer is run
+// directly, at the deadline the driver asked for
+class SoakRun
+{
+public:
+    explicit SoakRun(IndiAstroLink4mini2 *driver) : driver(driver) {}
+
+    bool connect(SoakRecorder &recorder, uint64_t faultInterval);
+    // false once the driver lost the loopback link
+    bool tick();
+    uint64_t badFrames() const
+    {
+        return driver->frameErrors;
+    }
+    uint64_t commandErrors() const
+    {
+        return driver->commandErrors;
+    }
+
+private:
+    IndiAstroLink4mini2 *driver;
+    uint32_t seed{1};
+    double nextMove{0}, nextPWM{300}, nextPort{450}, nextSettings{1800}, nextWeather{60};
+
+    uint32_t random(uint32_t range)
+    {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 8) % range;
+    }
+    void dropPollTimer();
+    void workload();
+};
+
+void SoakRun::dropPollTimer()
+{
+    // the timer would never fire without an event loop, it is only released
+    if (driver->pollTimer >= 0)
+        driver->RemoveTimer(driver->pollTimer);
+    driver->pollTimer = -1;
+}
+
+bool SoakRun::connect(SoakRecorder &recorder, uint64_t faultInterval)
+{
+    ISState states[1] = {ISS_ON};
+    char *names[1] = {const_cast<char *>("CONNECT")};
+    driver->ISGetProperties(nullptr);
+    driver->setSimulation(true);
+    driver->ISNewSwitch(driver->getDeviceName(), "CONNECTION", states, names, 1);
+    if (!driver->isConnected())
+        return false;
+    dropPollTimer();
+    driver->transport.reset(new SoakLoopback(recorder, faultInterval));
+    return true;
+}
+
+void SoakRun::workload()
+{
+    const IndiAstroLink4mini2::DeviceState &state = driver->deviceState();
+    int index = driver->getFindex();
+
+    // a move every simulated minute, once the previous one is done
+    if (soakClock >= nextMove && state.stepsToGo[index] == 0 && !driver->backlashPending)
+    {
+        driver->MoveAbsFocuser(random(static_cast<uint32_t>(driver->FocusMaxPosNP[0].getValue()) + 1));
+        nextMove = soakClock + 60;
+    }
+    if (soakClock >= nextPWM)
+    {
+        double values[2] = {static_cast<double>(random(101)), static_cast<double>(random(101))};
+        char *names[2] = {driver->PWMN[0].name, driver->PWMN[1].name};
+        driver->handlePWM(values, names, 2);
+        nextPWM = soakClock + 600;
+    }
+    if (soakClock >= nextPort)
+    {
+        // through the power transaction, the other outputs are kept
+        int port = random(3);
+        ISState states[1] = {state.output[port] ? ISS_OFF : ISS_ON};
+        char *names[1] = {driver->PowerTransactionS[port].name};
+        driver->handlePowerTransactionPorts(states, names, 1);
+        nextPort = soakClock + 900;
+    }
+    if (soakClock >= nextSettings)
+    {
+        double values[1] = {static_cast<double>(50 + random(150))};
+        char *names[1] = {driver->Focuser1SettingsN[IndiAstroLink4mini2::FS1_SPEED].name};
+        driver->handleFocuserSettings<0>(values, names, 1);
+        nextSettings = soakClock + 3600;
+    }
+    if (soakClock >= nextWeather)
+    {
+        driver->updateWeather();
+        nextWeather = soakClock + 60;
+    }
+}
+
+bool SoakRun::tick()
+{
+    soakClock = std::max(soakClock, driver->pollDeadline);
+    workload();
+    driver->TimerHit();
+    dropPollTimer();
+    return driver->isConnected() && driver->linkState != IndiAstroLink4mini2::LINK_DOWN;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [--hours H] [--tolerance PERCENT] [--fault-interval POLLS]\n"
+            "          [--baseline FILE] [--save-baseline FILE]\n", name);
+}
+
+static bool readFile(const char *path, std::string &text)
+{
+    char buffer[256] = {0};
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+    bool ok = fgets(buffer, sizeof(buffer), file) != nullptr;
+    fclose(file);
+    text = buffer;
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    double hours = 12, tolerance = 20;
+    uint64_t faultInterval = 500;
+    const char *baselinePath = nullptr, *savePath = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!value)
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        if (!strcmp(argv[i], "--hours"))
+            hours = atof(value);
+        else if (!strcmp(argv[i], "--tolerance"))
+            tolerance = atof(value);
+        else if (!strcmp(argv[i], "--fault-interval"))
+            faultInterval = strtoull(value, nullptr, 10);
+        else if (!strcmp(argv[i], "--baseline"))
+            baselinePath = value;
+        else if (!strcmp(argv[i], "--save-baseline"))
+            savePath = value;
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (hours <= 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // the configuration of the machine running the harness is left alone
+    setenv("INDICONFIG", "/dev/null", 1);
+    // the driver talks XML on stdout, the report goes to the original one
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    int null = open("/dev/null", O_WRONLY);
+    if (!out || null < 0 || dup2(null, STDOUT_FILENO) < 0)
+    {
+        fprintf(stderr, "Cannot redirect the driver output.\n");
+        return 2;
+    }
+    close(null);
+
+    // one cycle per status query, the full frame is read every POLLTIME
+    size_t cycles = hours * 3600.0 * 1000.0 / POLLTIME;
+    SoakRecorder recorder;
+    SoakRun run(indiFocuserLink.get());
+    if (!run.connect(recorder, faultInterval))
+    {
+        fprintf(stderr, "The driver did not connect to the loopback controller.\n");
+        return 2;
+    }
+    recorder.begin(cycles);
+    while (!recorder.isComplete())
+    {
+        if (!run.tick())
+        {
+            fprintf(stderr, "Loopback link failed after %zu polls.\n", recorder.cycles());
+            return 2;
+        }
+    }
+
+    SoakRecorder::Result result = recorder.result();
+    fprintf(out, "Simulated %.1f h in %zu polls, %llu bad frames rejected, %llu command errors\n", hours, result.cycles,
+            static_cast<unsigned long long>(run.badFrames()), static_cast<unsigned long long>(run.commandErrors()));
+    fprintf(out, "CPU per poll %.3f ms, drift %.1f %%\n", result.cpuPerCycle, result.cpuDrift);
+    fprintf(out, "RSS %.0f kB after warm up, %.0f kB at end, growth %.0f kB\n", result.rssWarm, result.rssEnd, result.rssGrowth);
+    fprintf(out, "Status round trip p50 %.3f ms, p95 %.3f ms, p99 %.3f ms\n", result.p50, result.p95, result.p99);
+
+    if (savePath)
+    {
+        FILE *file = fopen(savePath, "w");
+        if (!file || fprintf(file, "%s\n", SoakRecorder::formatBaseline(result).c_str()) < 0)
+        {
+            fprintf(stderr, "Cannot write baseline %s\n", savePath);
+            if (file)
+                fclose(file);
+            return 2;
+        }
+        fclose(file);
+    }
+
+    std::string text, report;
+    SoakRecorder::Result baseline;
+    if (!baselinePath)
+        return 0;
+    if (!readFile(baselinePath, text) || !SoakRecorder::parseBaseline(text.c_str(), baseline))
+    {
+        fprintf(stderr, "Cannot read baseline %s\n", baselinePath);
+        return 2;
+    }
+    if (!SoakRecorder::compare(result, baseline, tolerance, report))
+    {
+        fprintf(out, "Regressed against the baseline: %s\n", report.c_str());
+        return 1;
+    }
+    fprintf(out, "Passed against the baseline.\n");
+    return 0;
+}
@@ -0,0 +1,308 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "astrolink4_transport.h"
+
+#include "indicom.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+//////////////////////////////////////////////////////////////////////
+/// Transport
+//////////////////////////////////////////////////////////////////////
+int AstroLinkTransport::transact(const char *cmd, char *res, int len, int timeoutMs)
+{
+    char command[256];
+    int n = snprintf(command, sizeof(command), "%s\n", cmd);
+    if (n <= 0 || n >= static_cast<int>(sizeof(command)))
+        return TTY_OVERFLOW;
+
+    flush();
+    int rc = write(command, n);
+    if (rc != TTY_OK || !res)
+        return rc;
+
+    int nbytes = 0;
+    if ((rc = readLine(res, len, timeoutMs, &nbytes)) != TTY_OK)
+        return rc;
+    if (nbytes <= 1)
+        return TTY_READ_ERROR;
+    res[nbytes - 1] = '\0';
+    return TTY_OK;
+}
+
+int AstroLinkTransport::transactBatch(const char *const cmds[], char *const res[], int count, int len, int timeoutMs)
+{
+    flush();
+    for (int i = 0; i < count; i++)
+    {
+        char command[256];
+        int n = snprintf(command, sizeof(command), "%s\n", cmds[i]);
+        if (n <= 0 || n >= static_cast<int>(sizeof(command)))
+            return TTY_OVERFLOW;
+        int rc = write(command, n);
+        if (rc != TTY_OK)
+            return rc;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        int nbytes = 0;
+        int rc = readLine(res[i], len, timeoutMs, &nbytes);
+        if (rc != TTY_OK)
+            return rc;
+        if (nbytes <= 1)
+            return TTY_READ_ERROR;
+        res[i][nbytes - 1] = '\0';
+    }
+    return TTY_OK;
+}
+
+int readLineFD(int fd, char *res, int len, int timeoutMs, int *nbytes)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    *nbytes = 0;
+    while (*nbytes < len - 1)
+    {
+        int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0)
+            return TTY_TIME_OUT;
+
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int rc = poll(&pfd, 1, remaining);
+        if (rc == 0)
+            return TTY_TIME_OUT;
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return TTY_SELECT_ERROR;
+        }
+
+        ssize_t n = read(fd, res + *nbytes, 1);
+        if (n <= 0)
+            return TTY_READ_ERROR;
+        if (res[(*nbytes)++] == '\n')
+        {
+            res[*nbytes] = '\0';
+            return TTY_OK;
+        }
+    }
+    return TTY_OVERFLOW;
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Serial
+//////////////////////////////////////////////////////////////////////
+void SerialTransport::flush()
+{
+    tcflush(fd, TCIOFLUSH);
+}
+
+int SerialTransport::write(const char *data, int len)
+{
+    int nbytes = 0;
+    return tty_write(fd, data, len, &nbytes);
+}
+
+int SerialTransport::readLine(char *res, int len, int timeoutMs, int *nbytes)
+{
+    return readLineFD(fd, res, len, timeoutMs, nbytes);
+}
+
+//////////////////////////////////////////////////////////////////////
+/// TCP
+//////////////////////////////////////////////////////////////////////
+TcpTransport::TcpTransport(int fd) : fd(fd)
+{
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+void TcpTransport::flush()
+{
+    char buf[64];
+    while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        ;
+}
+
+int TcpTransport::write(const char *data, int len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return TTY_WRITE_ERROR;
+        }
+        data += n;
+        len -= n;
+    }
+    return TTY_OK;
+}
+
+int TcpTransport::readLine(char *res, int len, int timeoutMs, int *nbytes)
+{
+    return readLineFD(fd, res, len, timeoutMs, nbytes);
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Loopback
+//////////////////////////////////////////////////////////////////////
+static std::vector<std::string> splitFields(const std::string &input)
+{
+    std::vector<std::string> fields;
+    size_t start = 0, end;
+    while ((end = input.find(':', start)) != std::string::npos)
+    {
+        fields.push_back(input.substr(start, end - start));
+        start = end + 1;
+    }
+    fields.push_back(input.substr(start));
+    return fields;
+}
+
+LoopbackTransport::LoopbackTransport(std::function<double()> clock) : now(clock)
+{
+    if (!now)
+        now = []()
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        };
+    settings = splitFields("u:1:1:80:120:30:50:200:800:200:800:0:2:10000:80000:0:0:50:18:30:15:5:10:10:0:1:0:0:0:0:0:0:0:40:90:10:1100:14000:10000:100:0");
+}
+
+void LoopbackTransport::move()
+{
+    double t = now();
+    double dt = (lastUpdate >= 0) ? t - lastUpdate : 0;
+    lastUpdate = t;
+    for (int i = 0; i < 2; i++)
+    {
+        // speed fields are U_FOC1_SPEED and U_FOC2_SPEED
+        double step = std::atof(settings[7 + i].c_str()) * dt;
+        double distance = target[i] - position[i];
+        position[i] = (std::fabs(distance) <= step) ? target[i] : position[i] + (distance > 0 ? step : -step);
+    }
+}
+
+void LoopbackTransport::flush()
+{
+    replies.clear();
+}
+
+int LoopbackTransport::write(const char *data, int len)
+{
+    std::string cmd(data, len);
+    if (!cmd.empty() && cmd.back() == '\n')
+        cmd.pop_back();
+    move();
+    reply.clear();
+    execute(cmd);
+    if (!reply.empty())
+        replies.push_back(reply);
+    return TTY_OK;
+}
+
+int LoopbackTransport::readLine(char *res, int len, int, int *nbytes)
+{
+    if (replies.empty())
+        return TTY_TIME_OUT;
+    *nbytes = snprintf(res, len, "%s\n", replies.front().c_str());
+    replies.pop_front();
+    if (*nbytes >= len)
+        return TTY_OVERFLOW;
+    return TTY_OK;
+}
+
+void LoopbackTransport::execute(const std::string &cmd)
+{
+    if (cmd.empty())
+        return;
+    std::vector<std::string> args = splitFields(cmd);
+    int index = (args.size() > 1) ? std::min(std::max(std::atoi(args[1].c_str()), 0), 2) : 0;
+    int value = (args.size() > 2) ? std::atoi(args[2].c_str()) : 0;
+    char buf[256];
+
+    switch (cmd[0])
+    {
+        case '#':
+            reply = "#:AstroLink4mini";
+            return;
+        case 'q':
+            snprintf(buf, sizeof(buf), "q:AL4MII:%d:%d:%d:%d:3.14:1:23.12:45:9.11:1:19.19:%d:%d:%d:%d:%d:12.11:7.62:20.01:132.11:33:0:0:0:1:-10.1:7.7:1:19.19:35:8.22:1:1:18.11",
+                     static_cast<int>(position[0]), std::abs(target[0] - static_cast<int>(position[0])),
+                     static_cast<int>(position[1]), std::abs(target[1] - static_cast<int>(position[1])),
+                     pwm[0], pwm[1], output[0], output[1], output[2]);
+            reply = buf;
+            return;
+        case 'p':
+            reply = "p:" + std::to_string(static_cast<int>(position[std::min(index, 1)]));
+            return;
+        case 'i':
+            reply = std::string("i:") + (target[std::min(index, 1)] != static_cast<int>(position[std::min(index, 1)]) ? "1" : "0");
+            return;
+        case 'u':
+        {
+            reply.clear();
+            for (const auto &field : settings)
+                reply += field + ":";
+            reply.pop_back();
+            return;
+        }
+        case 'U':
+            // the driver sends back the whole 'u' frame with a trailing separator
+            for (size_t i = 1; i < args.size() && i < settings.size(); i++)
+                settings[i] = args[i];
+            break;
+        case 'A':
+            reply = "A:4.5.0 mini II";
+            return;
+        case 'R':
+            target[std::min(index, 1)] = std::max(value, 0);
+            break;
+        case 'H':
+            target[std::min(index, 1)] = static_cast<int>(position[std::min(index, 1)]);
+            break;
+        case 'P':
+            position[std::min(index, 1)] = target[std::min(index, 1)] = value;
+            break;
+        case 'C':
+            output[index] = value > 0 ? 1 : 0;
+            break;
+        case 'B':
+            pwm[std::min(index, 1)] = std::min(std::max(value, 0), 100);
+            break;
+        default:
+            break;
+    }
+    reply = std::string(1, cmd[0]) + ":";
+}
@@ -0,0 +1,123 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+
+#ifndef ASTROLINK4_TRANSPORT_H
+#define ASTROLINK4_TRANSPORT_H
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Line based request/reply link to the controller. Every command is
+// terminated by a new line and answered by a single line. Results use
+// the indicom TTY_* codes, so tty_error_msg() can describe them.
+class AstroLinkTransport
+{
+public:
+    virtual ~AstroLinkTransport() = default;
+    virtual const char *name() const = 0;
+
+    // res == nullptr sends the command without waiting for a reply
+    int transact(const char *cmd, char *res, int len, int timeoutMs);
+    // Pipelined exchange: all commands are written before the first reply is
+    // read, res[i] receives the reply to cmds[i].
+    int transactBatch(const char *const cmds[], char *const res[], int count, int len, int timeoutMs);
+
+protected:
+    // drops bytes left over from earlier exchanges
+    virtual void flush() = 0;
+    virtual int write(const char *data, int len) = 0;
+    virtual int readLine(char *res, int len, int timeoutMs, int *nbytes) = 0;
+};
+
+// Reads a new line terminated reply from a file descriptor within the timeout
+int readLineFD(int fd, char *res, int len, int timeoutMs, int *nbytes);
+
+class SerialTransport : public AstroLinkTransport
+{
+public:
+    explicit SerialTransport(int fd) : fd(fd) {}
+    const char *name() const override
+    {
+        return "serial";
+    }
+
+protected:
+    void flush() override;
+    int write(const char *data, int len) override;
+    int readLine(char *res, int len, int timeoutMs, int *nbytes) override;
+
+private:
+    int fd;
+};
+
+// Serial bridges like ser2net. No tty flushing, small commands go out
+// immediately with TCP_NODELAY and stale bytes are drained without blocking.
+class TcpTransport : public AstroLinkTransport
+{
+public:
+    explicit TcpTransport(int fd);
+    const char *name() const override
+    {
+        return "tcp";
+    }
+
+protected:
+    void flush() override;
+    int write(const char *data, int len) override;
+    int readLine(char *res, int len, int timeoutMs, int *nbytes) override;
+
+private:
+    int fd;
+};
+
+// In-process model of the controller, used in simulation mode and to exercise
+// the protocol code without hardware. Focusers move at the configured speed
+// against the clock, which can be replaced to run in accelerated time.
+class LoopbackTransport : public AstroLinkTransport
+{
+public:
+    // clock returns seconds, the steady clock when none is given
+    explicit LoopbackTransport(std::function<double()> clock = nullptr);
+    const char *name() const override
+    {
+        return "loopback";
+    }
+
+protected:
+    void flush() override;
+    int write(const char *data, int len) override;
+    int readLine(char *res, int len, int timeoutMs, int *nbytes) override;
+
+private:
+    std::function<double()> now;
+    std::string reply;
+    std::deque<std::string> replies;
+    std::vector<std::string> settings;
+    double position[2] {1234, 5678};
+    int target[2] {1234, 5678};
+    double lastUpdate{-1};
+    int pwm[2] {35, 80};
+    int output[3] {1, 0, 1};
+    void move();
+    void execute(const std::string &cmd);
+};
+
+#endif
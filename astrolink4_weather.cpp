@@ -0,0 +1,147 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+#include "astrolink4_weather.h"
+
+#include <cmath>
+
+//////////////////////////////////////////////////////////////////////
+/// Sliding window statistics
+//////////////////////////////////////////////////////////////////////
+SlidingWindowStats::SlidingWindowStats(double windowSeconds) : window(windowSeconds)
+{
+}
+
+void SlidingWindowStats::setWindow(double windowSeconds)
+{
+    window = windowSeconds;
+    if (!samples.empty())
+        expire(samples.back().t);
+}
+
+void SlidingWindowStats::clear()
+{
+    samples.clear();
+    minQueue.clear();
+    maxQueue.clear();
+    sumT = sumTT = sumV = sumVV = sumTV = 0;
+}
+
+void SlidingWindowStats::add(double timestamp, double value)
+{
+    if (samples.empty())
+    {
+        // sums are kept relative to the first sample to avoid cancellation
+        t0 = timestamp;
+        v0 = value;
+    }
+
+    Sample sample{timestamp, value};
+    samples.push_back(sample);
+    while (!minQueue.empty() && minQueue.back().v >= value)
+        minQueue.pop_back();
+    minQueue.push_back(sample);
+    while (!maxQueue.empty() && maxQueue.back().v <= value)
+        maxQueue.pop_back();
+    maxQueue.push_back(sample);
+
+    double t = timestamp - t0, v = value - v0;
+    sumT += t;
+    sumTT += t * t;
+    sumV += v;
+    sumVV += v * v;
+    sumTV += t * v;
+
+    expire(timestamp);
+}
+
+void SlidingWindowStats::expire(double now)
+{
+    while (samples.size() > 1 && now - samples.front().t > window)
+    {
+        const Sample &old = samples.front();
+        double t = old.t - t0, v = old.v - v0;
+        sumT -= t;
+        sumTT -= t * t;
+        sumV -= v;
+        sumVV -= v * v;
+        sumTV -= t * v;
+        if (minQueue.front().t <= old.t)
+            minQueue.pop_front();
+        if (maxQueue.front().t <= old.t)
+            maxQueue.pop_front();
+        samples.pop_front();
+    }
+}
+
+double SlidingWindowStats::min() const
+{
+    return minQueue.empty() ? 0 : minQueue.front().v;
+}
+
+double SlidingWindowStats::max() const
+{
+    return maxQueue.empty() ? 0 : maxQueue.front().v;
+}
+
+double SlidingWindowStats::mean() const
+{
+    return samples.empty() ? 0 : v0 + sumV / samples.size();
+}
+
+double SlidingWindowStats::stddev() const
+{
+    size_t n = samples.size();
+    if (n < 2)
+        return 0;
+    double m = sumV / n;
+    double variance = (sumVV - n * m * m) / (n - 1);
+    return variance > 0 ? std::sqrt(variance) : 0;
+}
+
+double SlidingWindowStats::rate() const
+{
+    size_t n = samples.size();
+    if (n < 2)
+        return 0;
+    double denominator = n * sumTT - sumT * sumT;
+    if (std::fabs(denominator) < 1e-9)
+        return 0;
+    return 60.0 * (n * sumTV - sumT * sumV) / denominator;
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Hysteresis
+//////////////////////////////////////////////////////////////////////
+bool HysteresisFlag::configure(double tripLevel, double releaseLevel)
+{
+    if ((direction == RISING) ? releaseLevel > tripLevel : releaseLevel < tripLevel)
+        return false;
+    trip = tripLevel;
+    release = releaseLevel;
+    return true;
+}
+
+bool HysteresisFlag::update(double value)
+{
+    bool rising = direction == RISING;
+    if (tripped)
+        tripped = rising ? value > release : value < release;
+    else
+        tripped = rising ? value >= trip : value <= trip;
+    return tripped;
+}
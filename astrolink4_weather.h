@@ -0,0 +1,95 @@
+/*******************************************************************************
+ Copyright(c) 2022 astrojolo.com
+ .
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#ifndef ASTROLINK4_WEATHER_H
+#define ASTROLINK4_WEATHER_H
+
+#include <deque>
+#include <cstddef>
+
+// Statistics of the samples received during the last window seconds.
+// Every sample is pushed and expired exactly once, so updates are O(1) amortized:
+// min/max are kept in monotonic deques, mean, variance and the least squares
+// slope in running sums relative to the first sample of the window.
+class SlidingWindowStats
+{
+public:
+    explicit SlidingWindowStats(double windowSeconds = 300.0);
+
+    void setWindow(double windowSeconds);
+    void add(double timestamp, double value);
+    void clear();
+
+    size_t count() const
+    {
+        return samples.size();
+    }
+    double min() const;
+    double max() const;
+    double mean() const;
+    double stddev() const;
+    // change per minute
+    double rate() const;
+
+private:
+    struct Sample
+    {
+        double t;
+        double v;
+    };
+    std::deque<Sample> samples;
+    std::deque<Sample> minQueue;
+    std::deque<Sample> maxQueue;
+    double window;
+    double t0{0}, v0{0};
+    double sumT{0}, sumTT{0}, sumV{0}, sumVV{0}, sumTV{0};
+    void expire(double now);
+};
+
+// Two threshold state switch. It trips when the value crosses the trip level
+// and releases only after crossing the release level, so a value hovering
+// around a single limit does not toggle the state on every poll.
+class HysteresisFlag
+{
+public:
+    enum Direction
+    {
+        RISING,     // trips above the trip level, release <= trip
+        FALLING     // trips below the trip level, release >= trip
+    };
+    explicit HysteresisFlag(Direction direction) : direction(direction) {}
+
+    // false and the levels kept when they are in the wrong order for the direction
+    bool configure(double tripLevel, double releaseLevel);
+    bool update(double value);
+    void reset()
+    {
+        tripped = false;
+    }
+    bool isTripped() const
+    {
+        return tripped;
+    }
+
+private:
+    Direction direction;
+    double trip{0}, release{0};
+    bool tripped{false};
+};
+
+#endif
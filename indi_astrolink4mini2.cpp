@@ -19,19 +19,48 @@
 
 #include "indicom.h"
 
+#include <lilxml.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+
 #define VERSION_MAJOR 0
 #define VERSION_MINOR 2
 
-#define ASTROLINK4_LEN 250
 #define ASTROLINK4_TIMEOUT 3
 
 #define POLLTIME 500
+// handlers query the device again when the decoded state is older than this [s]
+#define STATE_MAX_AGE 0.25
+#define FAULT_POLLTIME 100
+#define SWEEP_POLLTIME 100
+#define MOTION_POLLTIME 100
+
+#define OVERTYPE_VOLTAGE 1
+#define OVERTYPE_CURRENT 2
+
+#define MAX_PRESETS 16
+
+#define LINK_TRIP_FAILURES 3
+#define LINK_PROBE_TIMEOUT 300
+#define LINK_BACKOFF_MIN 1.0
+#define LINK_BACKOFF_MAX 60.0
+
+// a camera driver that stopped reporting no longer holds the poll back
+#define GUARD_STALE 30.0
 
 //////////////////////////////////////////////////////////////////////
 /// Delegates
 //////////////////////////////////////////////////////////////////////
 std::unique_ptr<IndiAstroLink4mini2> indiFocuserLink(new IndiAstroLink4mini2());
 
+static double wallClockNow()
+{
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
 //////////////////////////////////////////////////////////////////////
 ///Constructor
 //////////////////////////////////////////////////////////////////////
@@ -52,7 +81,18 @@ void ISPoll(void *p);
 
 bool IndiAstroLink4mini2::Handshake()
 {
-    PortFD = serialConnection->getPortFD();
+    if (isSimulation())
+        transport.reset(new LoopbackTransport(monotonicNow));
+    else if (getActiveConnection() == tcpConnection)
+        transport.reset(new TcpTransport(tcpConnection->getPortFD()));
+    else
+        transport.reset(new SerialTransport(serialConnection->getPortFD()));
+    DEBUGF(INDI::Logger::DBG_DEBUG, "Using %s transport", transport->name());
+    if (!reconnecting)
+    {
+        linkState = LINK_UP;
+        linkFailures = 0;
+    }
 
     char res[ASTROLINK4_LEN] = {0};
     if (sendCommand("#", res))
@@ -65,21 +105,111 @@ bool IndiAstroLink4mini2::Handshake()
         else
         {
             DEBUG(INDI::Logger::DBG_DEBUG, "Handshake success");
+            protectionType = -1;
+            motionQuerySupported = true;
+            // a reopened link keeps the configuration and the running poll
+            if (reconnecting)
+                return true;
             initComplete = false;
-            SetTimer(POLLTIME);
+
+            if (sendCommand("A", res) && strlen(res) > 2)
+            {
+                IUSaveText(&FirmwareT[FW_VERSION], res + 2);
+                LOGF_INFO("Firmware %s", res + 2);
+            }
+            sensorsKnown = false;
+            stateStale = true;
+            if (queryStatus() && deviceState().extended)
+                discoverSensors(deviceState().sensors);
+            startPolling();
             return true;
         }
     }
     return false;
 }
 
+void IndiAstroLink4mini2::startPolling()
+{
+    pollDeadline = monotonicNow() + POLLTIME / 1000.0;
+    lastTick = 0;
+    pollOverruns = 0;
+    pollJitter.clear();
+    pollInterval.clear();
+    pollLatency.clear();
+    // a reconnect restarts the loop, the tick still pending must not run a second one
+    if (pollTimer >= 0)
+        RemoveTimer(pollTimer);
+    pollTimer = SetTimer(POLLTIME);
+}
+
+uint32_t IndiAstroLink4mini2::pollPeriod()
+{
+    bool fastPoll = protectionType > 0 && ProtectionPollS[PROT_POLL_FAST].s == ISS_ON;
+    if (fastPoll)
+        return FAULT_POLLTIME;
+    // arrival at a sweep point is timestamped on the first poll that sees it
+    if (focusSweep.active && !focusSweep.settled)
+        return SWEEP_POLLTIME;
+    return motionTracking() ? MOTION_POLLTIME : POLLTIME;
+}
+
 void IndiAstroLink4mini2::TimerHit()
 {
+    pollTimer = -1;
+    batchingSets = true;
+
     if (isConnected())
     {
-        readDevice();
-        SetTimer(POLLTIME);
+        double now = monotonicNow();
+        pollJitter.add(now, std::fabs(now - pollDeadline) * 1000.0);
+        if (lastTick > 0)
+            pollInterval.add(now, now - lastTick);
+        lastTick = now;
+
+        if (linkState == LINK_DOWN)
+        {
+            // an unplugged adapter is reopened by the watcher, not by probes
+            if (now >= nextProbe && !portRemoved)
+                probeLink();
+        }
+        else if (!guardSkipsPoll(now))
+        {
+            readDevice();
+        }
+
+        // Fixed rate: the next tick is due one period after the previous deadline,
+        // not after this tick finished. Ticks that can no longer be met are skipped.
+        double period = pollPeriod() / 1000.0;
+        pollDeadline += period;
+        now = monotonicNow();
+        if (now > pollDeadline)
+        {
+            uint32_t missed = static_cast<uint32_t>((now - pollDeadline) / period) + 1;
+            pollOverruns += missed;
+            pollDeadline += missed * period;
+        }
+
+        // at the motion tracking rate the statistics would flood the clients
+        const double stats[7] =
+        {
+            deviceState().wallTime, pollInterval.mean() > 0 ? 1.0 / pollInterval.mean() : 0, pollJitter.mean(),
+            pollJitter.max(), static_cast<double>(pollOverruns), pollLatency.mean(), pollLatency.max()
+        };
+        bool changed = false;
+        for (int i = 0; i < 7; i++)
+            changed = changed || PollStatsN[i].value != stats[i];
+        if (changed && now - pollStatsPublished >= POLLTIME / 1000.0)
+        {
+            for (int i = 0; i < 7; i++)
+                PollStatsN[i].value = stats[i];
+            PollStatsNP.s = IPS_OK;
+            queueSet(&PollStatsNP);
+            pollStatsPublished = now;
+        }
+
+        pollTimer = SetTimer(std::max(1, static_cast<int>(std::lround((pollDeadline - now) * 1000.0))));
     }
+    flushProperties();
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -95,13 +225,15 @@ bool IndiAstroLink4mini2::initProperties()
     memset(focuserSelectLabel, 0, 15);
     setFindex(IUGetConfigOnSwitchName(getDeviceName(), FocuserSelectSP.name, focuserSelectLabel, 15) == 0 ? 0 : 1);
     initComplete = false;
+    properties.clear();
+    propertyIndex.clear();
 
     FI::SetCapability(FOCUSER_CAN_ABS_MOVE |
                       FOCUSER_CAN_REL_MOVE |
                       FOCUSER_CAN_REVERSE |
                       FOCUSER_CAN_SYNC |
-                      FOCUSER_CAN_ABORT);
-    //FOCUSER_HAS_BACKLASH);
+                      FOCUSER_CAN_ABORT |
+                      FOCUSER_HAS_BACKLASH);
 
     FI::initProperties(FOCUS_TAB);
     WI::initProperties(ENVIRONMENT_TAB, ENVIRONMENT_TAB);
@@ -118,9 +250,41 @@ bool IndiAstroLink4mini2::initProperties()
     serialConnection->setDefaultPort("/dev/ttyUSB0");
     serialConnection->setDefaultBaudRate(serialConnection->B_38400);
 
+    tcpConnection = new Connection::TCP(this);
+    tcpConnection->setConnectionType(Connection::TCP::TYPE_TCP);
+    tcpConnection->registerHandshake([&]()
+                                     { return Handshake(); });
+    registerConnection(tcpConnection);
+
     IUFillSwitch(&FocuserSelectS[0], "FOC_SEL_1", "Focuser 1", (getFindex() == 0 ? ISS_ON : ISS_OFF));
     IUFillSwitch(&FocuserSelectS[1], "FOC_SEL_2", "Focuser 2", (getFindex() > 0 ? ISS_ON : ISS_OFF));
     IUFillSwitchVector(&FocuserSelectSP, FocuserSelectS, 2, getDeviceName(), "FOCUSER_SELECT", "Focuser select", FOCUS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    registerProperty(&FocuserSelectSP, &IndiAstroLink4mini2::handleFocuserSelect, true, REFRESH_SETTINGS);
+
+    IUFillSwitch(&MotionTrackS[MOTION_TRACK_ENABLE], "MOTION_TRACK_ENABLE", "Enable", ISS_ON);
+    IUFillSwitch(&MotionTrackS[MOTION_TRACK_DISABLE], "MOTION_TRACK_DISABLE", "Disable", ISS_OFF);
+    IUFillSwitchVector(&MotionTrackSP, MotionTrackS, 2, getDeviceName(), "FOCUSER_MOTION_TRACKING", "Fast position polling", FOCUS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    registerProperty(&MotionTrackSP, &IndiAstroLink4mini2::handleMotionTracking, true, REFRESH_NONE);
+
+    // Focus sweep
+    IUFillNumber(&FocusSweepN[SWEEP_START], "SWEEP_START", "Start position", "%.0f", 0, 10000000, 100, 0);
+    IUFillNumber(&FocusSweepN[SWEEP_STEP], "SWEEP_STEP", "Step", "%.0f", -100000, 100000, 10, 100);
+    IUFillNumber(&FocusSweepN[SWEEP_COUNT], "SWEEP_COUNT", "Points", "%.0f", 1, 100, 1, 9);
+    IUFillNumber(&FocusSweepN[SWEEP_APPROACH], "SWEEP_APPROACH", "Approach from [steps]", "%.0f", 0, 100000, 10, 0);
+    IUFillNumber(&FocusSweepN[SWEEP_DWELL], "SWEEP_DWELL", "Dwell, 0 waits for next [s]", "%.1f", 0, 3600, 1, 0);
+    IUFillNumberVector(&FocusSweepNP, FocusSweepN, 5, getDeviceName(), "FOCUS_SWEEP", "Focus sweep", FOCUS_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&FocusSweepNP, &IndiAstroLink4mini2::handleFocusSweep, false, REFRESH_NONE);
+
+    IUFillSwitch(&FocusSweepControlS[SWEEP_NEXT], "SWEEP_NEXT", "Next point", ISS_OFF);
+    IUFillSwitch(&FocusSweepControlS[SWEEP_ABORT], "SWEEP_ABORT", "Abort", ISS_OFF);
+    IUFillSwitchVector(&FocusSweepControlSP, FocusSweepControlS, 2, getDeviceName(), "FOCUS_SWEEP_CONTROL", "Sweep", FOCUS_TAB, IP_RW, ISR_ATMOST1, 60, IPS_IDLE);
+    registerProperty(&FocusSweepControlSP, &IndiAstroLink4mini2::handleFocusSweepControl, false, REFRESH_NONE);
+
+    IUFillText(&FocusSweepPointT[SWEEP_POINT_INDEX], "SWEEP_POINT_INDEX", "Point", "");
+    IUFillText(&FocusSweepPointT[SWEEP_POINT_POSITION], "SWEEP_POINT_POSITION", "Position", "");
+    IUFillText(&FocusSweepPointT[SWEEP_POINT_TIME], "SWEEP_POINT_TIME", "Reached [UTC]", "");
+    IUFillTextVector(&FocusSweepPointTP, FocusSweepPointT, 3, getDeviceName(), "FOCUS_SWEEP_POINT", "Sweep point", FOCUS_TAB, IP_RO, 60, IPS_IDLE);
+    registerProperty(&FocusSweepPointTP, nullptr, false, REFRESH_NONE);
 
     // Power readings
     IUFillNumber(&PowerDataN[POW_VIN], "VIN", "Input voltage [V]", "%.1f", 0, 15, 10, 0);
@@ -129,30 +293,72 @@ bool IndiAstroLink4mini2::initProperties()
     IUFillNumber(&PowerDataN[POW_AH], "AH", "Energy consumed [Ah]", "%.1f", 0, 1000, 10, 0);
     IUFillNumber(&PowerDataN[POW_WH], "WH", "Energy consumed [Wh]", "%.1f", 0, 10000, 10, 0);
     IUFillNumberVector(&PowerDataNP, PowerDataN, 4, getDeviceName(), "POWER_DATA", "Power data", POWER_TAB, IP_RO, 60, IPS_IDLE);
+    registerProperty(&PowerDataNP, nullptr, false, REFRESH_TELEMETRY);
 
     // Power lines
     IUFillSwitch(&Power1S[0], "PWR1BTN_ON", "ON", ISS_OFF);
     IUFillSwitch(&Power1S[1], "PWR1BTN_OFF", "OFF", ISS_ON);
     IUFillSwitchVector(&Power1SP, Power1S, 2, getDeviceName(), "DC1", "Port 1", POWER_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+    registerProperty(&Power1SP, &IndiAstroLink4mini2::handlePower1, false, REFRESH_TELEMETRY);
 
     IUFillSwitch(&Power2S[0], "PWR2BTN_ON", "ON", ISS_OFF);
     IUFillSwitch(&Power2S[1], "PWR2BTN_OFF", "OFF", ISS_ON);
     IUFillSwitchVector(&Power2SP, Power2S, 2, getDeviceName(), "DC2", "Port 2", POWER_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+    registerProperty(&Power2SP, &IndiAstroLink4mini2::handlePower2, false, REFRESH_TELEMETRY);
 
     IUFillSwitch(&Power3S[0], "PWR3BTN_ON", "ON", ISS_OFF);
     IUFillSwitch(&Power3S[1], "PWR3BTN_OFF", "OFF", ISS_ON);
     IUFillSwitchVector(&Power3SP, Power3S, 2, getDeviceName(), "DC3", "Port 3", POWER_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+    registerProperty(&Power3SP, &IndiAstroLink4mini2::handlePower3, false, REFRESH_TELEMETRY);
 
     IUFillNumber(&PWMN[0], "PWM1_VAL", "A", "%3.0f", 0, 100, 10, 0);
     IUFillNumber(&PWMN[1], "PWM2_VAL", "B", "%3.0f", 0, 100, 10, 0);
     IUFillNumberVector(&PWMNP, PWMN, 2, getDeviceName(), "PWM", "PWM", POWER_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&PWMNP, &IndiAstroLink4mini2::handlePWM, false, REFRESH_TELEMETRY);
+
+    IUFillSwitch(&PowerTransactionS[0], "PT_DC1", "Port 1", ISS_OFF);
+    IUFillSwitch(&PowerTransactionS[1], "PT_DC2", "Port 2", ISS_OFF);
+    IUFillSwitch(&PowerTransactionS[2], "PT_DC3", "Port 3", ISS_OFF);
+    IUFillSwitchVector(&PowerTransactionSP, PowerTransactionS, 3, getDeviceName(), "POWER_TRANSACTION_PORTS", "Set all ports", POWER_TAB, IP_RW, ISR_NOFMANY, 60, IPS_IDLE);
+    registerProperty(&PowerTransactionSP, &IndiAstroLink4mini2::handlePowerTransactionPorts, false, REFRESH_NONE);
+
+    IUFillNumber(&PowerTransactionN[PT_PWM1], "PT_PWM1", "PWM 1 [%]", "%.0f", 0, 100, 5, 0);
+    IUFillNumber(&PowerTransactionN[PT_PWM2], "PT_PWM2", "PWM 2 [%]", "%.0f", 0, 100, 5, 0);
+    IUFillNumber(&PowerTransactionN[PT_STAGGER], "PT_STAGGER", "Port on stagger [ms]", "%.0f", 0, 1000, 50, 0);
+    IUFillNumberVector(&PowerTransactionNP, PowerTransactionN, 3, getDeviceName(), "POWER_TRANSACTION", "Set all outputs", POWER_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&PowerTransactionNP, &IndiAstroLink4mini2::handlePowerTransaction, false, REFRESH_NONE);
 
     IUFillSwitch(&PowerDefaultOnS[0], "POW_DEF_ON1", "DC1", ISS_OFF);
     IUFillSwitch(&PowerDefaultOnS[1], "POW_DEF_ON2", "DC2", ISS_OFF);
     IUFillSwitch(&PowerDefaultOnS[2], "POW_DEF_ON3", "DC3", ISS_OFF);
     IUFillSwitchVector(&PowerDefaultOnSP, PowerDefaultOnS, 3, getDeviceName(), "POW_DEF_ON", "Power default ON", POWER_TAB, IP_RW, ISR_NOFMANY, 60, IPS_IDLE);
+    registerProperty(&PowerDefaultOnSP, &IndiAstroLink4mini2::handlePowerDefaultOn, false, REFRESH_SETTINGS);
 	IUFillNumber(&SQMOffsetN[0], "SQMOffset", "mag/arcsec2", "%0.2f", -1, 1, 0.01, 0);
 	IUFillNumberVector(&SQMOffsetNP, SQMOffsetN, 1, getDeviceName(), "SQMOFFSET", "SQM calibration", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);    
+    registerProperty(&SQMOffsetNP, &IndiAstroLink4mini2::handleSQMOffset, true, REFRESH_NONE);
+
+    // Protection
+    IUFillLight(&ProtectionL[PROT_VOLTAGE], "PROT_VOLTAGE", "Over-voltage", IPS_IDLE);
+    IUFillLight(&ProtectionL[PROT_CURRENT], "PROT_CURRENT", "Over-current", IPS_IDLE);
+    IUFillLightVector(&ProtectionLP, ProtectionL, 2, getDeviceName(), "PROTECTION_STATUS", "Protection", POWER_TAB, IPS_IDLE);
+    registerProperty(&ProtectionLP, REFRESH_TELEMETRY);
+
+    IUFillText(&ProtectionEventT[PROT_EVENT_TYPE], "PROT_EVENT_TYPE", "Type", "None");
+    IUFillText(&ProtectionEventT[PROT_EVENT_VALUE], "PROT_EVENT_VALUE", "Value", "");
+    IUFillText(&ProtectionEventT[PROT_EVENT_TIME], "PROT_EVENT_TIME", "Time (UTC)", "");
+    IUFillTextVector(&ProtectionEventTP, ProtectionEventT, 3, getDeviceName(), "PROTECTION_EVENT", "Last protection event", POWER_TAB, IP_RO, 60, IPS_IDLE);
+    registerProperty(&ProtectionEventTP, nullptr, false, REFRESH_TELEMETRY);
+
+    IUFillNumber(&ProtectionSettingsN[PROT_OVERVOLTAGE], "PROT_OVERVOLTAGE", "Over-voltage limit [V]", "%.1f", 10, 16, 0.1, 14);
+    IUFillNumber(&ProtectionSettingsN[PROT_OVERCURRENT], "PROT_OVERCURRENT", "Over-current limit [A]", "%.1f", 1, 15, 0.1, 10);
+    IUFillNumber(&ProtectionSettingsN[PROT_OVERTIME], "PROT_OVERTIME", "Over-load time [ms]", "%.0f", 10, 1000, 10, 100);
+    IUFillNumberVector(&ProtectionSettingsNP, ProtectionSettingsN, 3, getDeviceName(), "PROTECTION_SETTINGS", "Protection limits", POWER_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&ProtectionSettingsNP, &IndiAstroLink4mini2::handleProtectionSettings, false, REFRESH_SETTINGS);
+
+    IUFillSwitch(&ProtectionPollS[PROT_POLL_FAST], "PROT_POLL_FAST", "Fast", ISS_ON);
+    IUFillSwitch(&ProtectionPollS[PROT_POLL_NORMAL], "PROT_POLL_NORMAL", "Normal", ISS_OFF);
+    IUFillSwitchVector(&ProtectionPollSP, ProtectionPollS, 2, getDeviceName(), "PROTECTION_POLLING", "Polling on fault", POWER_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    registerProperty(&ProtectionPollSP, &IndiAstroLink4mini2::handleProtectionPolling, true, REFRESH_NONE);
     
 
     // focuser settings
@@ -163,6 +369,7 @@ bool IndiAstroLink4mini2::initProperties()
     IUFillNumber(&Focuser1SettingsN[FS1_COMPENSATION], "FS1_COMPENSATION", "Compensation [steps/C]", "%.2f", -1000, 1000, 1, 0);
     IUFillNumber(&Focuser1SettingsN[FS1_COMP_THRESHOLD], "FS1_COMP_THRESHOLD", "Compensation threshold [steps]", "%.0f", 1, 1000, 10, 10);
     IUFillNumberVector(&Focuser1SettingsNP, Focuser1SettingsN, 6, getDeviceName(), "FOCUSER1_SETTINGS", "Focuser 1 settings", FOC1_SETTINGS_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&Focuser1SettingsNP, &IndiAstroLink4mini2::handleFocuserSettings<0>, false, REFRESH_SETTINGS);
 
     IUFillNumber(&Focuser2SettingsN[FS2_SPEED], "FS2_SPEED", "Speed [pps]", "%.0f", 10, 200, 1, 100);
     IUFillNumber(&Focuser2SettingsN[FS2_CURRENT], "FS2_CURRENT", "Current [mA]", "%.0f", 100, 2000, 100, 400);
@@ -171,16 +378,35 @@ bool IndiAstroLink4mini2::initProperties()
     IUFillNumber(&Focuser2SettingsN[FS2_COMPENSATION], "FS2_COMPENSATION", "Compensation [steps/C]", "%.2f", -1000, 1000, 1, 0);
     IUFillNumber(&Focuser2SettingsN[FS2_COMP_THRESHOLD], "FS2_COMP_THRESHOLD", "Compensation threshold [steps]", "%.0f", 1, 1000, 10, 10);
     IUFillNumberVector(&Focuser2SettingsNP, Focuser2SettingsN, 6, getDeviceName(), "FOCUSER2_SETTINGS", "Focuser 2 settings", FOC2_SETTINGS_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&Focuser2SettingsNP, &IndiAstroLink4mini2::handleFocuserSettings<1>, false, REFRESH_SETTINGS);
 
     IUFillSwitch(&Focuser1ModeS[FS1_MODE_UNI], "FS1_MODE_UNI", "Unipolar", ISS_ON);
     IUFillSwitch(&Focuser1ModeS[FS1_MODE_MICRO_L], "FS1_MODE_MICRO_L", "Microstep 1/8", ISS_OFF);
     IUFillSwitch(&Focuser1ModeS[FS1_MODE_MICRO_H], "FS1_MODE_MICRO_H", "Microstep 1/32", ISS_OFF);
     IUFillSwitchVector(&Focuser1ModeSP, Focuser1ModeS, 3, getDeviceName(), "FOCUSER1_MODE", "Focuser mode", FOC1_SETTINGS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    registerProperty(&Focuser1ModeSP, &IndiAstroLink4mini2::handleFocuserMode<0>, false, REFRESH_SETTINGS);
 
     IUFillSwitch(&Focuser2ModeS[FS2_MODE_UNI], "FS2_MODE_UNI", "Unipolar", ISS_ON);
     IUFillSwitch(&Focuser2ModeS[FS2_MODE_MICRO_L], "FS2_MODE_MICRO_L", "Microstep 1/8", ISS_OFF);
     IUFillSwitch(&Focuser2ModeS[FS2_MODE_MICRO_H], "FS2_MODE_MICRO_H", "Microstep 1/32", ISS_OFF);
     IUFillSwitchVector(&Focuser2ModeSP, Focuser2ModeS, 3, getDeviceName(), "FOCUSER2_MODE", "Focuser mode", FOC2_SETTINGS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    registerProperty(&Focuser2ModeSP, &IndiAstroLink4mini2::handleFocuserMode<1>, false, REFRESH_SETTINGS);
+
+    // Focuser presets
+    IUFillText(&PresetNameT[0], "PRESET_NAME", "Name", "");
+    IUFillTextVector(&PresetNameTP, PresetNameT, 1, getDeviceName(), "FOCUSER_PRESET_NAME", "Preset", SETTINGS_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&PresetNameTP, &IndiAstroLink4mini2::handlePresetName, false, REFRESH_NONE);
+
+    IUFillSwitch(&PresetActionS[PRESET_SAVE], "PRESET_SAVE", "Save", ISS_OFF);
+    IUFillSwitch(&PresetActionS[PRESET_APPLY], "PRESET_APPLY", "Apply", ISS_OFF);
+    IUFillSwitch(&PresetActionS[PRESET_DELETE], "PRESET_DELETE", "Delete", ISS_OFF);
+    IUFillSwitchVector(&PresetActionSP, PresetActionS, 3, getDeviceName(), "FOCUSER_PRESET_ACTION", "Preset", SETTINGS_TAB, IP_RW, ISR_ATMOST1, 60, IPS_IDLE);
+    registerProperty(&PresetActionSP, &IndiAstroLink4mini2::handlePresetAction, false, REFRESH_NONE);
+
+    // name=speed,current,hold,step,compensation,threshold,mode,max,reverse; per preset
+    IUFillText(&PresetsT[0], "PRESETS", "Stored", "");
+    IUFillTextVector(&PresetsTP, PresetsT, 1, getDeviceName(), "FOCUSER_PRESETS", "Presets", SETTINGS_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&PresetsTP, &IndiAstroLink4mini2::handlePresets, true, REFRESH_NONE);
 
     // Environment Group
 	addParameter("WEATHER_TEMPERATURE", "Temperature [C]", -15, 35, 15);
@@ -189,6 +415,140 @@ bool IndiAstroLink4mini2::initProperties()
 	addParameter("WEATHER_SKY_TEMP", "Sky temperature [C]", -50, 20, 20);
 	addParameter("WEATHER_SKY_DIFF", "Temperature difference [C]", -5, 40, 10);
 	addParameter("SQM_READING", "Sky brightness [mag/arcsec2]", 10, 25, 15);
+    // hysteresis verdicts on the window means, 1 when unsafe, so WEATHER_STATUS follows them
+    addParameter("WEATHER_CLOUD_RISK", "Cloudy", 0, 0, 0);
+    addParameter("WEATHER_DEW_RISK", "Dew risk", 0, 0, 0);
+    setCriticalParameter("WEATHER_CLOUD_RISK");
+    setCriticalParameter("WEATHER_DEW_RISK");
+
+    // Weather statistics and safety
+    IUFillNumber(&WeatherSafetyN[WS_WINDOW], "WS_WINDOW", "Statistics window [s]", "%.0f", 30, 3600, 30, 300);
+    IUFillNumber(&WeatherSafetyN[WS_CLOUDY], "WS_CLOUDY", "Cloudy above sky diff [C]", "%.1f", -40, 10, 1, -15);
+    IUFillNumber(&WeatherSafetyN[WS_CLEAR], "WS_CLEAR", "Clear below sky diff [C]", "%.1f", -40, 10, 1, -18);
+    IUFillNumber(&WeatherSafetyN[WS_DEW_UNSAFE], "WS_DEW_UNSAFE", "Dew risk below margin [C]", "%.1f", 0, 10, 0.5, 2);
+    IUFillNumber(&WeatherSafetyN[WS_DEW_SAFE], "WS_DEW_SAFE", "Dew clear above margin [C]", "%.1f", 0, 10, 0.5, 3);
+    IUFillNumberVector(&WeatherSafetyNP, WeatherSafetyN, 5, getDeviceName(), "WEATHER_SAFETY_SETTINGS", "Safety limits", ENVIRONMENT_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&WeatherSafetyNP, &IndiAstroLink4mini2::handleWeatherSafety, true, REFRESH_NONE);
+    cloudFlag.configure(WeatherSafetyN[WS_CLOUDY].value, WeatherSafetyN[WS_CLEAR].value);
+    dewFlag.configure(WeatherSafetyN[WS_DEW_UNSAFE].value, WeatherSafetyN[WS_DEW_SAFE].value);
+
+    const char *statParams[WSTAT_COUNT][2] = {{"TEMPERATURE", "Temperature"}, {"HUMIDITY", "Humidity"}, {"DEW_MARGIN", "Dew margin"}, {"SKY_DIFF", "Sky diff"}};
+    const char *statNames[STAT_COUNT][2] = {{"MIN", "min"}, {"MAX", "max"}, {"MEAN", "mean"}, {"STDDEV", "std dev"}, {"RATE", "rate [/min]"}};
+    for (int p = 0; p < WSTAT_COUNT; p++)
+    {
+        for (int i = 0; i < STAT_COUNT; i++)
+        {
+            char name[MAXINDINAME], label[MAXINDILABEL];
+            snprintf(name, MAXINDINAME, "%s_%s", statParams[p][0], statNames[i][0]);
+            snprintf(label, MAXINDILABEL, "%s %s", statParams[p][1], statNames[i][1]);
+            IUFillNumber(&WeatherStatsN[p * STAT_COUNT + i], name, label, "%.2f", -100, 100, 0, 0);
+        }
+    }
+    IUFillNumberVector(&WeatherStatsNP, WeatherStatsN, WSTAT_COUNT * STAT_COUNT, getDeviceName(), "WEATHER_STATISTICS", "Statistics", ENVIRONMENT_TAB, IP_RO, 60, IPS_IDLE);
+    registerProperty(&WeatherStatsNP, nullptr, false, REFRESH_TELEMETRY);
+
+    IUFillLight(&SafetyStatusL[SAFETY_CLOUD], "SAFETY_CLOUD", "Clouds", IPS_IDLE);
+    IUFillLight(&SafetyStatusL[SAFETY_DEW], "SAFETY_DEW", "Dew", IPS_IDLE);
+    IUFillLightVector(&SafetyStatusLP, SafetyStatusL, 2, getDeviceName(), "WEATHER_SAFETY", "Safety", ENVIRONMENT_TAB, IPS_IDLE);
+    registerProperty(&SafetyStatusLP, REFRESH_TELEMETRY);
+
+    // Poll statistics
+    IUFillNumber(&PollStatsN[POLL_SAMPLE_TIME], "POLL_SAMPLE_TIME", "Last sample [unix s]", "%.3f", 0, 1e10, 0, 0);
+    IUFillNumber(&PollStatsN[POLL_RATE], "POLL_RATE", "Sample rate [Hz]", "%.2f", 0, 100, 0, 0);
+    IUFillNumber(&PollStatsN[POLL_JITTER_MEAN], "POLL_JITTER_MEAN", "Jitter mean [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&PollStatsN[POLL_JITTER_MAX], "POLL_JITTER_MAX", "Jitter max [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&PollStatsN[POLL_OVERRUNS], "POLL_OVERRUNS", "Overruns", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumber(&PollStatsN[POLL_LATENCY_MEAN], "POLL_LATENCY_MEAN", "Latency mean [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&PollStatsN[POLL_LATENCY_MAX], "POLL_LATENCY_MAX", "Latency max [ms]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumberVector(&PollStatsNP, PollStatsN, 7, getDeviceName(), "POLL_STATISTICS", "Polling", DIAGNOSTICS_TAB, IP_RO, 60, IPS_IDLE);
+    registerProperty(&PollStatsNP, nullptr, false, REFRESH_NONE);
+
+    // Link health
+    IUFillNumber(&LinkHealthN[LINK_FAILURES], "LINK_FAILURES", "Consecutive failures", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumber(&LinkHealthN[LINK_TRIPS], "LINK_TRIPS", "Link lost", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumber(&LinkHealthN[LINK_RECONNECTS], "LINK_RECONNECTS", "Reconnects", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumber(&LinkHealthN[LINK_RETRY], "LINK_RETRY", "Retry interval [s]", "%.0f", 0, 3600, 0, 0);
+    IUFillNumberVector(&LinkHealthNP, LinkHealthN, 4, getDeviceName(), "LINK_HEALTH", "Link", DIAGNOSTICS_TAB, IP_RO, 60, IPS_IDLE);
+    registerProperty(&LinkHealthNP, nullptr, false, REFRESH_NONE);
+
+    IUFillSwitch(&HotplugS[HOTPLUG_ENABLE], "HOTPLUG_ENABLE", "Enable", ISS_ON);
+    IUFillSwitch(&HotplugS[HOTPLUG_DISABLE], "HOTPLUG_DISABLE", "Disable", ISS_OFF);
+    IUFillSwitchVector(&HotplugSP, HotplugS, 2, getDeviceName(), "HOTPLUG", "Hot plug", DIAGNOSTICS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    registerProperty(&HotplugSP, &IndiAstroLink4mini2::handleHotplug, true, REFRESH_NONE);
+    IUFillText(&HotplugT[0], "HOTPLUG_LINK", "Watched link", "");
+    IUFillTextVector(&HotplugTP, HotplugT, 1, getDeviceName(), "HOTPLUG_LINK", "Hot plug", DIAGNOSTICS_TAB, IP_RO, 60, IPS_IDLE);
+    registerProperty(&HotplugTP, nullptr, false, REFRESH_NONE);
+
+    // Focuser motion profile
+    IUFillNumber(&MotionProfileN[MP_MOVES], "MP_MOVES", "Moves recorded", "%.0f", 0, 1000, 0, 0);
+    IUFillNumber(&MotionProfileN[MP_AVG_PPS], "MP_AVG_PPS", "Average speed [pps]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&MotionProfileN[MP_PEAK_PPS], "MP_PEAK_PPS", "Peak speed [pps]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&MotionProfileN[MP_AVG_DURATION], "MP_AVG_DURATION", "Average time to complete [s]", "%.2f", 0, 10000, 0, 0);
+    IUFillNumber(&MotionProfileN[MP_MAX_OVERSHOOT], "MP_MAX_OVERSHOOT", "Max overshoot [steps]", "%.0f", 0, 100000, 0, 0);
+    IUFillNumber(&MotionProfileN[MP_LAST_PPS], "MP_LAST_PPS", "Last move speed [pps]", "%.1f", 0, 10000, 0, 0);
+    IUFillNumber(&MotionProfileN[MP_LAST_DURATION], "MP_LAST_DURATION", "Last move time [s]", "%.2f", 0, 10000, 0, 0);
+    IUFillNumber(&MotionProfileN[MP_LAST_OVERHEAD], "MP_LAST_OVERHEAD", "Last move overhead [s]", "%.2f", -10000, 10000, 0, 0);
+    IUFillNumberVector(&MotionProfileNP, MotionProfileN, 8, getDeviceName(), "FOCUSER_PROFILE", "Motion profile", DIAGNOSTICS_TAB, IP_RO, 60, IPS_IDLE);
+    registerProperty(&MotionProfileNP, nullptr, false, REFRESH_NONE);
+
+    // a file name only, the log is written to the INDI configuration directory
+    IUFillText(&MotionLogPathT[0], "MP_LOG_FILE", "File", "astrolink4mini2_moves.csv");
+    IUFillTextVector(&MotionLogPathTP, MotionLogPathT, 1, getDeviceName(), "FOCUSER_PROFILE_LOG", "Move log", DIAGNOSTICS_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&MotionLogPathTP, &IndiAstroLink4mini2::handleMotionLogPath, true, REFRESH_NONE);
+
+    IUFillSwitch(&MotionLogS[MP_LOG_EXPORT], "MP_LOG_EXPORT", "Export", ISS_OFF);
+    IUFillSwitch(&MotionLogS[MP_LOG_CLEAR], "MP_LOG_CLEAR", "Clear", ISS_OFF);
+    IUFillSwitchVector(&MotionLogSP, MotionLogS, 2, getDeviceName(), "FOCUSER_PROFILE_ACTION", "Move log", DIAGNOSTICS_TAB, IP_RW, ISR_ATMOST1, 60, IPS_IDLE);
+    registerProperty(&MotionLogSP, &IndiAstroLink4mini2::handleMotionLog, false, REFRESH_NONE);
+
+    // Camera guard
+    IUFillText(&CameraGuardT[0], "GUARD_DEVICE", "Camera", "");
+    IUFillTextVector(&CameraGuardTP, CameraGuardT, 1, getDeviceName(), "CCD_GUARD", "Camera guard", SETTINGS_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&CameraGuardTP, &IndiAstroLink4mini2::handleCameraGuard, true, REFRESH_NONE);
+
+    IUFillSwitch(&CameraGuardModeS[GUARD_OFF], "GUARD_OFF", "Off", ISS_ON);
+    IUFillSwitch(&CameraGuardModeS[GUARD_THIN], "GUARD_THIN", "Thin polling", ISS_OFF);
+    IUFillSwitch(&CameraGuardModeS[GUARD_PAUSE], "GUARD_PAUSE", "Pause polling", ISS_OFF);
+    IUFillSwitchVector(&CameraGuardModeSP, CameraGuardModeS, 3, getDeviceName(), "CCD_GUARD_MODE", "During readout", SETTINGS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    registerProperty(&CameraGuardModeSP, &IndiAstroLink4mini2::handleCameraGuardMode, true, REFRESH_NONE);
+
+    IUFillNumber(&CameraGuardN[GUARD_THIN_PERIOD], "GUARD_THIN_PERIOD", "Thinned poll period [s]", "%.1f", 1, 60, 1, 5);
+    IUFillNumber(&CameraGuardN[GUARD_READOUT], "GUARD_READOUT", "Readout from remaining [s]", "%.1f", 0, 30, 0.5, 0.5);
+    IUFillNumberVector(&CameraGuardNP, CameraGuardN, 2, getDeviceName(), "CCD_GUARD_SETTINGS", "Camera guard", SETTINGS_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&CameraGuardNP, &IndiAstroLink4mini2::handleCameraGuardSettings, true, REFRESH_NONE);
+
+    IUFillNumber(&CameraGuardStatusN[GUARD_EXPOSING], "GUARD_EXPOSING", "Exposing", "%.0f", 0, 1, 0, 0);
+    IUFillNumber(&CameraGuardStatusN[GUARD_SKIPPED], "GUARD_SKIPPED", "Polls suppressed", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumber(&CameraGuardStatusN[GUARD_DEFERRED], "GUARD_DEFERRED", "Settings writes deferred", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumber(&CameraGuardStatusN[GUARD_HELD], "GUARD_HELD", "Moves held", "%.0f", 0, 1e9, 0, 0);
+    IUFillNumberVector(&CameraGuardStatusNP, CameraGuardStatusN, 4, getDeviceName(), "CCD_GUARD_STATUS", "Camera guard", DIAGNOSTICS_TAB, IP_RO, 60, IPS_IDLE);
+    registerProperty(&CameraGuardStatusNP, nullptr, false, REFRESH_NONE);
+
+    // Firmware and attached sensors, filled in at connect
+    IUFillText(&FirmwareT[FW_VERSION], "FW_VERSION", "Firmware", "");
+    IUFillText(&FirmwareT[FW_SENSORS], "FW_SENSORS", "Sensors", "");
+    IUFillTextVector(&FirmwareTP, FirmwareT, 2, getDeviceName(), "FIRMWARE_INFO", "Controller", INFO_TAB, IP_RO, 60, IPS_OK);
+    registerProperty(&FirmwareTP, nullptr, false, REFRESH_NONE);
+
+    // Sensor 2, defined only while attached
+    IUFillNumber(&Sensor2N[0], "SENS2_TEMP", "Temperature [C]", "%.1f", -50, 100, 0, 0);
+    IUFillNumberVector(&Sensor2NP, Sensor2N, 1, getDeviceName(), "SENSOR2", "Temperature probe", ENVIRONMENT_TAB, IP_RO, 60, IPS_IDLE);
+    registerProperty(&Sensor2NP, nullptr, false, REFRESH_NONE, SENSOR_SENS2);
+    IUFillNumber(&Sensor2EN[SENS2E_TEMP], "SENS2E_TEMP", "Temperature [C]", "%.1f", -50, 100, 0, 0);
+    IUFillNumber(&Sensor2EN[SENS2E_HUM], "SENS2E_HUM", "Humidity %", "%.0f", 0, 100, 0, 0);
+    IUFillNumber(&Sensor2EN[SENS2E_DEW], "SENS2E_DEW", "Dew point [C]", "%.1f", -50, 50, 0, 0);
+    IUFillNumberVector(&Sensor2ENP, Sensor2EN, 3, getDeviceName(), "SENSOR2_EXT", "Sensor 2", ENVIRONMENT_TAB, IP_RO, 60, IPS_IDLE);
+    registerProperty(&Sensor2ENP, nullptr, false, REFRESH_NONE, SENSOR_SENS2E);
+
+    // Metrics exporter
+    IUFillText(&MetricsEndpointT[0], "METRICS_ENDPOINT", "Endpoint", "unix:/tmp/indi_astrolink4mini2.metrics");
+    IUFillTextVector(&MetricsEndpointTP, MetricsEndpointT, 1, getDeviceName(), "METRICS_ENDPOINT", "Metrics endpoint", DIAGNOSTICS_TAB, IP_RW, 60, IPS_IDLE);
+    registerProperty(&MetricsEndpointTP, &IndiAstroLink4mini2::handleMetricsEndpoint, true, REFRESH_NONE);
+
+    IUFillSwitch(&MetricsS[METRICS_ENABLE], "METRICS_ENABLE", "Enable", ISS_OFF);
+    IUFillSwitch(&MetricsS[METRICS_DISABLE], "METRICS_DISABLE", "Disable", ISS_ON);
+    IUFillSwitchVector(&MetricsSP, MetricsS, 2, getDeviceName(), "METRICS_EXPORTER", "Metrics exporter", DIAGNOSTICS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+    registerProperty(&MetricsSP, &IndiAstroLink4mini2::handleMetrics, true, REFRESH_NONE);
     
 
     return true;
@@ -203,33 +563,28 @@ bool IndiAstroLink4mini2::updateProperties()
     {
         FI::updateProperties();
         WI::updateProperties();
-        defineProperty(&FocuserSelectSP);
-        defineProperty(&Focuser1SettingsNP);
-        defineProperty(&Focuser2SettingsNP);
-        defineProperty(&Focuser1ModeSP);
-        defineProperty(&Focuser2ModeSP);
-        defineProperty(&PowerDataNP);
-        defineProperty(&Power1SP);
-        defineProperty(&Power2SP);
-        defineProperty(&Power3SP);
-        defineProperty(&PWMNP);
-        defineProperty(&PowerDefaultOnSP);
-        defineProperty(&SQMOffsetNP);    
+        for (const auto &entry : properties)
+        {
+            if (entryDefined(entry))
+                defineEntry(entry);
+        }
+        startHotplug();
     }
     else
     {
-        deleteProperty(SQMOffsetNP.name);
-        deleteProperty(PowerDataNP.name);
-        deleteProperty(Focuser1SettingsNP.name);
-        deleteProperty(Focuser2SettingsNP.name);
-        deleteProperty(Focuser1ModeSP.name);
-        deleteProperty(Focuser2ModeSP.name);
-        deleteProperty(FocuserSelectSP.name);
-        deleteProperty(Power1SP.name);
-        deleteProperty(Power2SP.name);
-        deleteProperty(Power3SP.name);
-        deleteProperty(PWMNP.name);
-        deleteProperty(PowerDefaultOnSP.name);
+        metricsExporter.stop();
+        portWatcher.stop();
+        portRemoved = false;
+        if (staggerTimer >= 0)
+        {
+            IERmTimer(staggerTimer);
+            staggerTimer = -1;
+        }
+        for (auto it = properties.rbegin(); it != properties.rend(); ++it)
+        {
+            if (entryDefined(*it))
+                deleteProperty(it->name());
+        }
         WI::updateProperties();
         FI::updateProperties();
     }
@@ -241,90 +596,9 @@ bool IndiAstroLink4mini2::ISNewNumber(const char *dev, const char *name, double
 {
     if (dev && !strcmp(dev, getDeviceName()))
     {
-        char cmd[ASTROLINK4_LEN] = {0};
-        char res[ASTROLINK4_LEN] = {0};
-
-        // Handle PWM
-        if (!strcmp(name, PWMNP.name))
-        {
-            bool allOk = true;
-            if (PWMN[0].value != values[0])
-            {
-                sprintf(cmd, "B:0:%d", static_cast<uint8_t>(values[0]));
-                allOk = allOk && sendCommand(cmd, res);
-            }
-            if (PWMN[1].value != values[1])
-            {
-                sprintf(cmd, "B:1:%d", static_cast<uint8_t>(values[1]));
-                allOk = allOk && sendCommand(cmd, res);
-            }
-            PWMNP.s = (allOk) ? IPS_BUSY : IPS_ALERT;
-            if (allOk)
-                IUUpdateNumber(&PWMNP, values, names, n);
-            IDSetNumber(&PWMNP, nullptr);
-            return true;
-        }
-        
-        // SQM calibration
-        if (!strcmp(name, SQMOffsetNP.name))
-        {
-            SQMOffsetNP.s = IPS_BUSY;
-            IUUpdateNumber(&SQMOffsetNP, values, names, n);
-            SQMOffsetNP.s = IPS_OK;
-            IDSetNumber(&SQMOffsetNP, nullptr);
-            return true;
-        }            
-
-        // Focuser settings
-        if (!strcmp(name, Focuser1SettingsNP.name))
-        {
-            bool allOk = true;
-            std::map<int, std::string> updates;
-            updates[U_FOC1_STEP] = doubleToStr(values[FS1_STEP_SIZE] * 100.0);
-            updates[U_FOC1_COMPSTEPS] = doubleToStr(values[FS1_COMPENSATION] * 100.0);
-            updates[U_FOC1_COMPTRIGGER] = doubleToStr(values[FS1_COMP_THRESHOLD]);
-            updates[U_FOC1_SPEED] = intToStr(values[FS1_SPEED]);
-            updates[U_FOC1_ACC] = intToStr(values[FS1_SPEED] * 5.0);
-            updates[U_FOC1_CUR] = intToStr(values[FS1_CURRENT] / 10.0);
-            updates[U_FOC1_HOLD] = intToStr(values[FS1_HOLD]);
-            allOk = allOk && updateSettings("u", "U", updates);
-            updates.clear();
-            if (allOk)
-            {
-                Focuser1SettingsNP.s = IPS_BUSY;
-                IUUpdateNumber(&Focuser1SettingsNP, values, names, n);
-                IDSetNumber(&Focuser1SettingsNP, nullptr);
-                DEBUGF(INDI::Logger::DBG_SESSION, "Focuser 1 temperature compensation is %s", (values[FS1_COMPENSATION] > 0) ? "enabled" : "disabled");
-                return true;
-            }
-            Focuser1SettingsNP.s = IPS_ALERT;
-            return true;
-        }
-
-        if (!strcmp(name, Focuser2SettingsNP.name))
-        {
-            bool allOk = true;
-            std::map<int, std::string> updates;
-            updates[U_FOC2_STEP] = doubleToStr(values[FS2_STEP_SIZE] * 100.0);
-            updates[U_FOC2_COMPSTEPS] = doubleToStr(values[FS2_COMPENSATION] * 100.0);
-            updates[U_FOC2_COMPTRIGGER] = doubleToStr(values[FS2_COMP_THRESHOLD]);
-            updates[U_FOC2_SPEED] = intToStr(values[FS2_SPEED]);
-            updates[U_FOC2_ACC] = intToStr(values[FS2_SPEED] * 5.0);
-            updates[U_FOC2_CUR] = intToStr(values[FS2_CURRENT] / 10.0);
-            updates[U_FOC2_HOLD] = intToStr(values[FS2_HOLD]);
-            allOk = allOk && updateSettings("u", "U", updates);
-            updates.clear();
-            if (allOk)
-            {
-                Focuser2SettingsNP.s = IPS_BUSY;
-                IUUpdateNumber(&Focuser2SettingsNP, values, names, n);
-                IDSetNumber(&Focuser2SettingsNP, nullptr);
-                DEBUGF(INDI::Logger::DBG_SESSION, "Focuser 2 temperature compensation is %s", (values[FS2_COMPENSATION] > 0) ? "enabled" : "disabled");
-                return true;
-            }
-            Focuser2SettingsNP.s = IPS_ALERT;
-            return true;
-        }
+        const PropertyEntry *entry = findProperty(name);
+        if (entry && entry->onNumber)
+            return (this->*(entry->onNumber))(values, names, n);
 
         if (strstr(name, "FOCUS_"))
             return FI::processNumber(dev, name, values, names, n);
@@ -338,126 +612,9 @@ bool IndiAstroLink4mini2::ISNewSwitch(const char *dev, const char *name, ISState
 {
     if (dev && !strcmp(dev, getDeviceName()))
     {
-        char cmd[ASTROLINK4_LEN] = {0};
-        char res[ASTROLINK4_LEN] = {0};
-
-        // handle power line 1
-        if (!strcmp(name, Power1SP.name))
-        {
-            sprintf(cmd, "C:0:%s", (strcmp(Power1S[0].name, names[0])) ? "0" : "1");
-            bool allOk = sendCommand(cmd, res);
-            Power1SP.s = allOk ? IPS_BUSY : IPS_ALERT;
-            if (allOk)
-                IUUpdateSwitch(&Power1SP, states, names, n);
-
-            IDSetSwitch(&Power1SP, nullptr);
-            return true;
-        }
-
-        // handle power line 2
-        if (!strcmp(name, Power2SP.name))
-        {
-            sprintf(cmd, "C:1:%s", (strcmp(Power2S[0].name, names[0])) ? "0" : "1");
-            bool allOk = sendCommand(cmd, res);
-            Power2SP.s = allOk ? IPS_BUSY : IPS_ALERT;
-            if (allOk)
-                IUUpdateSwitch(&Power2SP, states, names, n);
-
-            IDSetSwitch(&Power2SP, nullptr);
-            return true;
-        }
-
-        // handle power line 3
-        if (!strcmp(name, Power3SP.name))
-        {
-            sprintf(cmd, "C:2:%s", (strcmp(Power3S[0].name, names[0])) ? "0" : "1");
-            bool allOk = sendCommand(cmd, res);
-            Power3SP.s = allOk ? IPS_BUSY : IPS_ALERT;
-            if (allOk)
-                IUUpdateSwitch(&Power3SP, states, names, n);
-
-            IDSetSwitch(&Power3SP, nullptr);
-            return true;
-        }
-
-        // Power default on
-        if (!strcmp(name, PowerDefaultOnSP.name))
-        {
-            std::map<int, std::string> updates;
-            updates[U_OUT1_DEF] = (states[0] == ISS_ON) ? "1" : "0";
-            updates[U_OUT2_DEF] = (states[1] == ISS_ON) ? "1" : "0";
-            updates[U_OUT3_DEF] = (states[2] == ISS_ON) ? "1" : "0";
-            if (updateSettings("u", "U", updates))
-            {
-                PowerDefaultOnSP.s = IPS_BUSY;
-                IUUpdateSwitch(&PowerDefaultOnSP, states, names, n);
-                IDSetSwitch(&PowerDefaultOnSP, nullptr);
-                return true;
-            }
-            PowerDefaultOnSP.s = IPS_ALERT;
-            return true;
-        }
-
-        // Focuser Mode
-        if (!strcmp(name, Focuser1ModeSP.name))
-        {
-            std::string value = "0";
-            if (!strcmp(Focuser1ModeS[FS1_MODE_UNI].name, names[0]))
-                value = "0";
-            if (!strcmp(Focuser1ModeS[FS1_MODE_MICRO_L].name, names[0]))
-                value = "1";
-            if (!strcmp(Focuser1ModeS[FS1_MODE_MICRO_H].name, names[0]))
-                value = "2";
-            if (updateSettings("u", "U", U_FOC1_MODE, value.c_str()))
-            {
-                Focuser1ModeSP.s = IPS_BUSY;
-                IUUpdateSwitch(&Focuser1ModeSP, states, names, n);
-                IDSetSwitch(&Focuser1ModeSP, nullptr);
-                return true;
-            }
-            Focuser1ModeSP.s = IPS_ALERT;
-            return true;
-        }
-        if (!strcmp(name, Focuser2ModeSP.name))
-        {
-            std::string value = "0";
-            if (!strcmp(Focuser2ModeS[FS2_MODE_UNI].name, names[0]))
-                value = "0";
-            if (!strcmp(Focuser2ModeS[FS2_MODE_MICRO_L].name, names[0]))
-                value = "1";
-            if (!strcmp(Focuser2ModeS[FS2_MODE_MICRO_H].name, names[0]))
-                value = "2";
-            if (updateSettings("u", "U", U_FOC2_MODE, value.c_str()))
-            {
-                Focuser2ModeSP.s = IPS_BUSY;
-                IUUpdateSwitch(&Focuser2ModeSP, states, names, n);
-                IDSetSwitch(&Focuser2ModeSP, nullptr);
-                return true;
-            }
-            Focuser2ModeSP.s = IPS_ALERT;
-            return true;
-        }
-
-        // Stepper select
-        if (!strcmp(name, FocuserSelectSP.name))
-        {
-            if (initComplete)
-            {
-                setFindex((strcmp(FocuserSelectS[0].name, names[0])) ? 1 : 0);
-                DEBUGF(INDI::Logger::DBG_DEBUG, "Focuser index set by switch to %i", getFindex());
-                FocuserSelectSP.s  = IPS_BUSY;
-                IUUpdateSwitch(&FocuserSelectSP, states, names, n);
-                IDSetSwitch(&FocuserSelectSP, nullptr);
-                FocusMaxPosNP.setState(IPS_BUSY);
-                FocusMaxPosNP.apply();
-                FocusReverseSP.setState(IPS_BUSY);
-                FocusReverseSP.apply();
-                FocusAbsPosNP.setState(IPS_BUSY);
-                FocusAbsPosNP.apply();
-            }
-
-            return true;
-        }
+        const PropertyEntry *entry = findProperty(name);
+        if (entry && entry->onSwitch)
+            return (this->*(entry->onSwitch))(states, names, n);
 
         if (strstr(name, "FOCUS_")) 
             return FI::processSwitch(dev, name, states, names, n);
@@ -469,13 +626,58 @@ bool IndiAstroLink4mini2::ISNewSwitch(const char *dev, const char *name, ISState
 
 bool IndiAstroLink4mini2::ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n)
 {
+    if (dev && !strcmp(dev, getDeviceName()))
+    {
+        const PropertyEntry *entry = findProperty(name);
+        if (entry && entry->onText)
+            return (this->*(entry->onText))(texts, names, n);
+    }
     return INDI::DefaultDevice::ISNewText(dev, name, texts, names, n);
 }
 
+bool IndiAstroLink4mini2::ISSnoopDevice(XMLEle *root)
+{
+    const char *device = findXMLAttValu(root, "device");
+    const char *name = findXMLAttValu(root, "name");
+    if (*CameraGuardT[0].text && !strcmp(name, "CCD_EXPOSURE") && !strcmp(device, CameraGuardT[0].text))
+    {
+        IPState state = IPS_IDLE;
+        crackIPState(findXMLAttValu(root, "state"), &state);
+        for (XMLEle *ep = nextXMLEle(root, 1); ep != nullptr; ep = nextXMLEle(root, 0))
+        {
+            if (!strcmp(findXMLAttValu(ep, "name"), "CCD_EXPOSURE_VALUE"))
+                exposureRemaining = atof(pcdataXMLEle(ep));
+        }
+
+        bool wasReadout = readoutActive();
+        bool wasBusy = exposureBusy;
+        exposureBusy = (state == IPS_BUSY);
+        exposureSeen = monotonicNow();
+        // the first thinned poll is one period into the readout
+        if (!wasReadout && readoutActive())
+            lastGuardedPoll = exposureSeen;
+        if (wasBusy != exposureBusy)
+        {
+            DEBUGF(INDI::Logger::DBG_DEBUG, "Camera exposure %s", exposureBusy ? "started" : "ended");
+            publishCameraGuard();
+        }
+    }
+    return INDI::DefaultDevice::ISSnoopDevice(root);
+}
+
 bool IndiAstroLink4mini2::saveConfigItems(FILE *fp)
 {
-    IUSaveConfigSwitch(fp, &FocuserSelectSP);
-    IUSaveConfigNumber(fp, &SQMOffsetNP);
+    for (const auto &entry : properties)
+    {
+        if (!entry.persist)
+            continue;
+        if (entry.number)
+            IUSaveConfigNumber(fp, entry.number);
+        else if (entry.switches)
+            IUSaveConfigSwitch(fp, entry.switches);
+        else if (entry.text)
+            IUSaveConfigText(fp, entry.text);
+    }
     FI::saveConfigItems(fp);
     WI::saveConfigItems(fp);
     INDI::DefaultDevice::saveConfigItems(fp);
@@ -492,392 +694,2171 @@ bool IndiAstroLink4mini2::loadConfig(bool silent, const char *property)
 }
 
 //////////////////////////////////////////////////////////////////////
-/// Focuser interface
+/// Property handlers
 //////////////////////////////////////////////////////////////////////
-IPState IndiAstroLink4mini2::MoveAbsFocuser(uint32_t targetTicks)
+bool IndiAstroLink4mini2::handlePWM(double values[], char *names[], int n)
 {
-    char cmd[ASTROLINK4_LEN] = {0}, res[ASTROLINK4_LEN] = {0};
-    snprintf(cmd, ASTROLINK4_LEN, "R:%i:%u", getFindex(), targetTicks);
-    return (sendCommand(cmd, res)) ? IPS_BUSY : IPS_ALERT;
+    char cmd[ASTROLINK4_LEN] = {0};
+    char res[ASTROLINK4_LEN] = {0};
+    bool allOk = true;
+    const DeviceState &state = freshState();
+    if (state.pwm[0] != values[0])
+    {
+        sprintf(cmd, "B:0:%d", static_cast<uint8_t>(values[0]));
+        allOk = allOk && sendCommand(cmd, res);
+    }
+    if (state.pwm[1] != values[1])
+    {
+        sprintf(cmd, "B:1:%d", static_cast<uint8_t>(values[1]));
+        allOk = allOk && sendCommand(cmd, res);
+    }
+    PWMNP.s = (allOk) ? IPS_BUSY : IPS_ALERT;
+    if (allOk)
+        IUUpdateNumber(&PWMNP, values, names, n);
+    IDSetNumber(&PWMNP, nullptr);
+    return true;
 }
 
-IPState IndiAstroLink4mini2::MoveRelFocuser(FocusDirection dir, uint32_t ticks)
+bool IndiAstroLink4mini2::handleSQMOffset(double values[], char *names[], int n)
 {
-    return MoveAbsFocuser(dir == FOCUS_INWARD ? FocusAbsPosNP[0].getValue() - ticks : FocusAbsPosNP[0].getValue() + ticks);
+    SQMOffsetNP.s = IPS_BUSY;
+    IUUpdateNumber(&SQMOffsetNP, values, names, n);
+    SQMOffsetNP.s = IPS_OK;
+    IDSetNumber(&SQMOffsetNP, nullptr);
+    return true;
 }
 
-bool IndiAstroLink4mini2::AbortFocuser()
+template <int F>
+bool IndiAstroLink4mini2::handleFocuserSettings(double values[], char *names[], int n)
 {
-    char cmd[ASTROLINK4_LEN] = {0}, res[ASTROLINK4_LEN] = {0};
-    snprintf(cmd, ASTROLINK4_LEN, "H:%i", getFindex());
-    return (sendCommand(cmd, res));
+    static_assert(static_cast<int>(FS1_SPEED) == FS_SPEED && static_cast<int>(FS1_CURRENT) == FS_CURRENT &&
+                  static_cast<int>(FS1_HOLD) == FS_HOLD && static_cast<int>(FS1_STEP_SIZE) == FS_STEP_SIZE &&
+                  static_cast<int>(FS1_COMPENSATION) == FS_COMPENSATION &&
+                  static_cast<int>(FS1_COMP_THRESHOLD) == FS_COMP_THRESHOLD, "Focuser settings layout");
+    INumberVectorProperty &settingsNP = (F == 0) ? Focuser1SettingsNP : Focuser2SettingsNP;
+
+    // elements missing from the request keep their current values
+    double merged[FS_COUNT];
+    for (int i = 0; i < FS_COUNT; i++)
+        merged[i] = settingsNP.np[i].value;
+    for (int i = 0; i < n; i++)
+    {
+        INumber *np = IUFindNumber(&settingsNP, names[i]);
+        if (np)
+            merged[np - settingsNP.np] = values[i];
+    }
+
+    SettingsUpdate update;
+    FocuserFields<F>::encode(update, merged);
+    if (updateSettings(update) != IPS_ALERT)
+    {
+        settingsNP.s = IPS_BUSY;
+        IUUpdateNumber(&settingsNP, values, names, n);
+        IDSetNumber(&settingsNP, nullptr);
+        DEBUGF(INDI::Logger::DBG_SESSION, "Focuser %i temperature compensation is %s", F + 1, (merged[FS_COMPENSATION] > 0) ? "enabled" : "disabled");
+        return true;
+    }
+    settingsNP.s = IPS_ALERT;
+    return true;
 }
 
-bool IndiAstroLink4mini2::ReverseFocuser(bool enabled)
+bool IndiAstroLink4mini2::handlePower1(ISState *states, char *names[], int n)
+{
+    return setPowerOutput(0, &Power1SP, states, names, n);
+}
+
+bool IndiAstroLink4mini2::handlePower2(ISState *states, char *names[], int n)
+{
+    return setPowerOutput(1, &Power2SP, states, names, n);
+}
+
+bool IndiAstroLink4mini2::handlePower3(ISState *states, char *names[], int n)
+{
+    return setPowerOutput(2, &Power3SP, states, names, n);
+}
+
+bool IndiAstroLink4mini2::setPowerOutput(int output, ISwitchVectorProperty *svp, ISState *states, char *names[], int n)
+{
+    char cmd[ASTROLINK4_LEN] = {0};
+    char res[ASTROLINK4_LEN] = {0};
+    sprintf(cmd, "C:%i:%s", output, (strcmp(svp->sp[0].name, names[0])) ? "0" : "1");
+    bool allOk = sendCommand(cmd, res);
+    svp->s = allOk ? IPS_BUSY : IPS_ALERT;
+    if (allOk)
+        IUUpdateSwitch(svp, states, names, n);
+
+    IDSetSwitch(svp, nullptr);
+    return true;
+}
+
+bool IndiAstroLink4mini2::handlePowerTransaction(double values[], char *names[], int n)
+{
+    // outputs not in the update keep their current state
+    seedPowerTransaction();
+    IUUpdateNumber(&PowerTransactionNP, values, names, n);
+    startPowerTransaction();
+    return true;
+}
+
+bool IndiAstroLink4mini2::handlePowerTransactionPorts(ISState *states, char *names[], int n)
+{
+    seedPowerTransaction();
+    IUUpdateSwitch(&PowerTransactionSP, states, names, n);
+    startPowerTransaction();
+    return true;
+}
+
+void IndiAstroLink4mini2::seedPowerTransaction()
+{
+    const DeviceState &state = freshState();
+    for (int i = 0; i < 3; i++)
+        PowerTransactionS[i].s = state.output[i] ? ISS_ON : ISS_OFF;
+    for (int i = 0; i < 2; i++)
+        PowerTransactionN[PT_PWM1 + i].value = std::lround(state.pwm[i]);
+}
+
+void IndiAstroLink4mini2::startPowerTransaction()
 {
-    int index = getFindex() > 0 ? U_FOC2_REV : U_FOC1_REV;
-    if (updateSettings("u", "U", index, (enabled) ? "1" : "0"))
+    // a transaction still staggering its ports is superseded
+    if (staggerTimer >= 0)
     {
-        FocusReverseSP.setState(IPS_BUSY);
-        return true;
+        IERmTimer(staggerTimer);
+        staggerTimer = -1;
+    }
+
+    // ports switched off, the PWM channels and the first port switched on go in one pipelined batch,
+    // further ports are switched on by the timer to limit the inrush current
+    char commands[6][16];
+    const char *cmds[6];
+    int count = 0;
+    bool stagger = PowerTransactionN[PT_STAGGER].value > 0;
+    bool first = true;
+    staggerCount = staggerNext = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        bool on = PowerTransactionS[i].s == ISS_ON;
+        if (on && stagger && !first)
+        {
+            staggerPorts[staggerCount++] = i;
+            continue;
+        }
+        first = first && !on;
+        snprintf(commands[count++], sizeof(commands[0]), "C:%i:%i", i, on ? 1 : 0);
+    }
+    for (int i = 0; i < 2; i++)
+        snprintf(commands[count++], sizeof(commands[0]), "B:%i:%ld", i, std::lround(PowerTransactionN[PT_PWM1 + i].value));
+    for (int i = 0; i < count; i++)
+        cmds[i] = commands[i];
+
+    char replies[6][ASTROLINK4_LEN] = {};
+    char *res[6];
+    for (int i = 0; i < 6; i++)
+        res[i] = replies[i];
+
+    if (staggerCount == 0)
+    {
+        finishPowerTransaction(cmds, res, count);
+        return;
+    }
+    if (!sendBatch(cmds, res, count))
+    {
+        staggerCount = 0;
+        LOG_ERROR("Power outputs do not match the requested state.");
+        PowerTransactionNP.s = PowerTransactionSP.s = IPS_ALERT;
     }
     else
     {
-        return false;
+        staggerTimer = IEAddTimer(static_cast<int>(PowerTransactionN[PT_STAGGER].value), staggerHelper, this);
+        PowerTransactionNP.s = PowerTransactionSP.s = IPS_BUSY;
     }
+    IDSetNumber(&PowerTransactionNP, nullptr);
+    IDSetSwitch(&PowerTransactionSP, nullptr);
 }
 
-bool IndiAstroLink4mini2::SyncFocuser(uint32_t ticks)
+void IndiAstroLink4mini2::staggerHelper(void *context)
 {
-    char cmd[ASTROLINK4_LEN] = {0}, res[ASTROLINK4_LEN] = {0};
-    snprintf(cmd, ASTROLINK4_LEN, "P:%i:%u", getFindex(), ticks);
-    if (sendCommand(cmd, res))
+    static_cast<IndiAstroLink4mini2 *>(context)->staggerPort();
+}
+
+void IndiAstroLink4mini2::staggerPort()
+{
+    staggerTimer = -1;
+    char command[16];
+    char replies[2][ASTROLINK4_LEN] = {};
+    const char *cmds[2] = {command};
+    char *res[2] = {replies[0], replies[1]};
+    snprintf(command, sizeof(command), "C:%i:1", staggerPorts[staggerNext++]);
+    if (staggerNext == staggerCount)
     {
-        FocusAbsPosNP.setState(IPS_BUSY);
-        return true;
+        finishPowerTransaction(cmds, res, 1);
+        return;
     }
-    else
+    if (sendBatch(cmds, res, 1))
     {
-        return false;
+        staggerTimer = IEAddTimer(static_cast<int>(PowerTransactionN[PT_STAGGER].value), staggerHelper, this);
+        return;
     }
+    staggerCount = 0;
+    LOG_ERROR("Power outputs do not match the requested state.");
+    PowerTransactionNP.s = PowerTransactionSP.s = IPS_ALERT;
+    IDSetNumber(&PowerTransactionNP, nullptr);
+    IDSetSwitch(&PowerTransactionSP, nullptr);
 }
 
-bool IndiAstroLink4mini2::SetFocuserMaxPosition(uint32_t ticks)
+bool IndiAstroLink4mini2::finishPowerTransaction(const char *cmds[], char *res[], int count)
 {
-    int index = getFindex() > 0 ? U_FOC2_MAX : U_FOC1_MAX;
-    if (updateSettings("u", "U", index, std::to_string(ticks).c_str()))
+    // the last commands go out together with the confirming status query
+    cmds[count] = "q";
+    bool confirmed = false;
+    if (sendBatch(cmds, res, count + 1) && commitStatus(res[count], monotonicNow(), wallClockNow()))
     {
-        FocusMaxPosNP.setState(IPS_BUSY);
-        return true;
+        const DeviceState &state = deviceState();
+        confirmed = state.extended;
+        for (int i = 0; i < 3; i++)
+            confirmed = confirmed && state.output[i] == (PowerTransactionS[i].s == ISS_ON);
+        for (int i = 0; i < 2; i++)
+            confirmed = confirmed && std::lround(state.pwm[i]) == std::lround(PowerTransactionN[PT_PWM1 + i].value);
+        publishOutputs(state, true);
     }
-    else
+    staggerCount = 0;
+    if (!confirmed)
+        LOG_ERROR("Power outputs do not match the requested state.");
+    PowerTransactionNP.s = PowerTransactionSP.s = confirmed ? IPS_OK : IPS_ALERT;
+    IDSetNumber(&PowerTransactionNP, nullptr);
+    IDSetSwitch(&PowerTransactionSP, nullptr);
+    return confirmed;
+}
+
+void IndiAstroLink4mini2::publishOutputs(const DeviceState &state, bool switches)
+{
+    if (switches)
     {
-        return false;
+        ISwitchVectorProperty *power[3] = {&Power1SP, &Power2SP, &Power3SP};
+        for (int i = 0; i < 3; i++)
+        {
+            power[i]->sp[0].s = state.output[i] ? ISS_ON : ISS_OFF;
+            power[i]->sp[1].s = state.output[i] ? ISS_OFF : ISS_ON;
+            power[i]->s = IPS_OK;
+            queueSet(power[i]);
+        }
     }
+
+    PWMN[0].value = state.pwm[0];
+    PWMN[1].value = state.pwm[1];
+    PWMNP.s = IPS_OK;
+    queueSet(&PWMNP);
 }
 
-bool IndiAstroLink4mini2::SetFocuserBacklash(int32_t steps)
+bool IndiAstroLink4mini2::handlePowerDefaultOn(ISState *states, char *names[], int n)
 {
-    //backlashSteps = steps;
+    SettingsUpdate update;
+    update.setRaw(U_OUT1_DEF, (states[0] == ISS_ON) ? 1 : 0);
+    update.setRaw(U_OUT2_DEF, (states[1] == ISS_ON) ? 1 : 0);
+    update.setRaw(U_OUT3_DEF, (states[2] == ISS_ON) ? 1 : 0);
+    if (updateSettings(update) != IPS_ALERT)
+    {
+        PowerDefaultOnSP.s = IPS_BUSY;
+        IUUpdateSwitch(&PowerDefaultOnSP, states, names, n);
+        IDSetSwitch(&PowerDefaultOnSP, nullptr);
+        return true;
+    }
+    PowerDefaultOnSP.s = IPS_ALERT;
     return true;
 }
 
-bool IndiAstroLink4mini2::SetFocuserBacklashEnabled(bool enabled)
+template <int F>
+bool IndiAstroLink4mini2::handleFocuserMode(ISState *states, char *names[], int n)
 {
-    //backlashEnabled = enabled;
+    ISwitchVectorProperty &modeSP = (F == 0) ? Focuser1ModeSP : Focuser2ModeSP;
+    ISwitch *sp = IUFindSwitch(&modeSP, names[0]);
+    SettingsUpdate update;
+    update.set(FOCUSER_MODE_FIELD, F, sp ? sp - modeSP.sp : 0);
+    if (updateSettings(update) != IPS_ALERT)
+    {
+        modeSP.s = IPS_BUSY;
+        IUUpdateSwitch(&modeSP, states, names, n);
+        IDSetSwitch(&modeSP, nullptr);
+        return true;
+    }
+    modeSP.s = IPS_ALERT;
     return true;
 }
 
-//////////////////////////////////////////////////////////////////////
-/// Serial commands
-//////////////////////////////////////////////////////////////////////
-bool IndiAstroLink4mini2::sendCommand(const char *cmd, char *res)
+bool IndiAstroLink4mini2::handlePresetName(char *texts[], char *names[], int n)
 {
-    int nbytes_read = 0, nbytes_written = 0, tty_rc = 0;
-    char command[ASTROLINK4_LEN];
+    IUUpdateText(&PresetNameTP, texts, names, n);
+    PresetNameTP.s = IPS_OK;
+    IDSetText(&PresetNameTP, nullptr);
+    return true;
+}
 
-    if (isSimulation())
-    {
-        if (strncmp(cmd, "#", 1) == 0)
-            sprintf(res, "%s\n", "#:AstroLink4mini");
-        if (strncmp(cmd, "q", 1) == 0)
-            sprintf(res, "%s\n", "q:AL4MII:1234:0:5678:0:3.14:1:23.12:45:9.11:1:19.19:35:80:1:0:1:12.11:7.62:20.01:132.11:33:0:0:0:1:-10.1:7.7:1:19.19:35:8.22:1:1:18.11");
-        if (strncmp(cmd, "p", 1) == 0)
-            sprintf(res, "%s\n", "p:1234");
-        if (strncmp(cmd, "i", 1) == 0)
-            sprintf(res, "%s\n", "i:0");
-        if (strncmp(cmd, "u", 1) == 0)
-            sprintf(res, "%s\n", "u:1:1:80:120:30:50:200:800:200:800:0:2:10000:80000:0:0:50:18:30:15:5:10:10:0:1:0:0:0:0:0:0:0:40:90:10:1100:14000:10000:100:0");
-        if (strncmp(cmd, "A", 1) == 0)
-            sprintf(res, "%s\n", "A:4.5.0 mini II");
-        if (strncmp(cmd, "R", 1) == 0)
-            sprintf(res, "%s\n", "R:");
-        if (strncmp(cmd, "C", 1) == 0)
-            sprintf(res, "%s\n", "C:");
-        if (strncmp(cmd, "B", 1) == 0)
-            sprintf(res, "%s\n", "B:");
-        if (strncmp(cmd, "H", 1) == 0)
-            sprintf(res, "%s\n", "H:");
-        if (strncmp(cmd, "P", 1) == 0)
-            sprintf(res, "%s\n", "P:");
-        if (strncmp(cmd, "U", 1) == 0)
-            sprintf(res, "%s\n", "U:");
-        if (strncmp(cmd, "S", 1) == 0)
-            sprintf(res, "%s\n", "S:");
-    }
-    else
+bool IndiAstroLink4mini2::handlePresets(char *texts[], char *names[], int n)
+{
+    std::vector<FocuserPreset> parsed;
+    if (IUUpdateText(&PresetsTP, texts, names, n) < 0 || !parsePresets(PresetsT[0].text, parsed))
     {
-        tcflush(PortFD, TCIOFLUSH);
-        sprintf(command, "%s\n", cmd);
-        DEBUGF(INDI::Logger::DBG_DEBUG, "CMD %s", cmd);
-        if ((tty_rc = tty_write_string(PortFD, command, &nbytes_written)) != TTY_OK)
-            return false;
-
-        if (!res)
-        {
-            tcflush(PortFD, TCIOFLUSH);
-            return true;
-        }
-
-        if ((tty_rc = tty_nread_section(PortFD, res, ASTROLINK4_LEN, stopChar, ASTROLINK4_TIMEOUT, &nbytes_read)) != TTY_OK || nbytes_read == 1)
-            return false;
-
-        tcflush(PortFD, TCIOFLUSH);
-        res[nbytes_read - 1] = '\0';
-        DEBUGF(INDI::Logger::DBG_DEBUG, "RES %s", res);
-        if (tty_rc != TTY_OK)
-        {
-            char errorMessage[MAXRBUF];
-            tty_error_msg(tty_rc, errorMessage, MAXRBUF);
-            LOGF_ERROR("Serial error: %s", errorMessage);
-            return false;
-        }
+        // the text is put back to the presets still in use
+        LOG_ERROR("Invalid focuser presets.");
+        publishPresets(IPS_ALERT);
+        return true;
     }
-    return (cmd[0] == res[0]);
+    presets = parsed;
+    publishPresets();
+    return true;
 }
 
-bool IndiAstroLink4mini2::readDevice()
+bool IndiAstroLink4mini2::handlePresetAction(ISState *states, char *names[], int n)
 {
-    char res[ASTROLINK4_LEN] = {0};
-    if (sendCommand("q", res))
-    {
-        std::vector<std::string> result = split(res, ":");
-        result.erase(result.begin());
+    IUUpdateSwitch(&PresetActionSP, states, names, n);
+    int action = IUFindOnSwitchIndex(&PresetActionSP);
+    IUResetSwitch(&PresetActionSP);
 
-        int focuserPosition = std::stoi(result[getFindex() == 1 ? Q_FOC2_POS : Q_FOC1_POS]);
-        int stepsToGo = std::stod(result[getFindex() == 1 ? Q_FOC2_TO_GO : Q_FOC1_TO_GO]);
-        FocusAbsPosNP[0].setValue(focuserPosition);
-        if (stepsToGo == 0)
+    const char *name = PresetNameT[0].text;
+    auto preset = std::find_if(presets.begin(), presets.end(), [name](const FocuserPreset & p)
+    {
+        return p.name == name;
+    });
+    PresetActionSP.s = IPS_OK;
+    if (action == PRESET_SAVE)
+    {
+        if (!*name || strpbrk(name, "=,;") || (preset == presets.end() && presets.size() >= MAX_PRESETS))
         {
-            FocusAbsPosNP.setState(IPS_OK);
-            FocusRelPosNP.setState(IPS_OK);
+            LOGF_ERROR("Cannot save preset '%s'.", name);
+            PresetActionSP.s = IPS_ALERT;
         }
         else
         {
-            FocusAbsPosNP.setState(IPS_BUSY);
-            FocusRelPosNP.setState(IPS_BUSY);
+            const INumberVectorProperty &settingsNP = (getFindex() == 0) ? Focuser1SettingsNP : Focuser2SettingsNP;
+            FocuserPreset captured;
+            captured.name = name;
+            for (int i = 0; i < FS_COUNT; i++)
+                captured.settings[i] = settingsNP.np[i].value;
+            captured.mode = std::max(0, IUFindOnSwitchIndex((getFindex() == 0) ? &Focuser1ModeSP : &Focuser2ModeSP));
+            captured.maxPosition = FocusMaxPosNP[0].getValue();
+            captured.reverse = FocusReverseSP[0].getState() == ISS_ON;
+            if (preset == presets.end())
+                presets.push_back(captured);
+            else
+                *preset = captured;
+            publishPresets();
+            LOGF_INFO("Preset '%s' saved from focuser %i.", name, getFindex() + 1);
         }
-        FocusRelPosNP.apply();
-        FocusAbsPosNP.apply();
+    }
+    else if (preset == presets.end())
+    {
+        LOGF_ERROR("No preset named '%s'.", name);
+        PresetActionSP.s = IPS_ALERT;
+    }
+    else if (action == PRESET_APPLY)
+    {
+        if (applyPreset(*preset))
+        {
+            LOGF_INFO("Preset '%s' applied to focuser %i.", name, getFindex() + 1);
+        }
+        else
+        {
+            LOGF_ERROR("Cannot apply preset '%s'.", name);
+            PresetActionSP.s = IPS_ALERT;
+        }
+    }
+    else if (action == PRESET_DELETE)
+    {
+        presets.erase(preset);
+        publishPresets();
+    }
+    IDSetSwitch(&PresetActionSP, nullptr);
+    return true;
+}
+
+bool IndiAstroLink4mini2::applyPreset(const FocuserPreset &preset)
+{
+    int index = getFindex();
+    SettingsUpdate update;
+    if (index == 0)
+        FocuserFields<0>::encode(update, preset.settings);
+    else
+        FocuserFields<1>::encode(update, preset.settings);
+    update.set(FOCUSER_MODE_FIELD, index, preset.mode);
+    update.set(FOCUSER_MAX_FIELD, index, preset.maxPosition);
+    update.set(FOCUSER_REVERSE_FIELD, index, preset.reverse ? 1 : 0);
+    if (updateSettings(update) == IPS_ALERT)
+        return false;
+
+    // every property the frame touched is read back on the next settings refresh
+    INumberVectorProperty &settingsNP = (index == 0) ? Focuser1SettingsNP : Focuser2SettingsNP;
+    ISwitchVectorProperty &modeSP = (index == 0) ? Focuser1ModeSP : Focuser2ModeSP;
+    settingsNP.s = IPS_BUSY;
+    IDSetNumber(&settingsNP, nullptr);
+    modeSP.s = IPS_BUSY;
+    IDSetSwitch(&modeSP, nullptr);
+    FocusMaxPosNP.setState(IPS_BUSY);
+    FocusMaxPosNP.apply();
+    FocusReverseSP.setState(IPS_BUSY);
+    FocusReverseSP.apply();
+    return true;
+}
+
+bool IndiAstroLink4mini2::parsePresets(const char *text, std::vector<FocuserPreset> &parsed)
+{
+    std::string list = text;
+    size_t start = 0;
+    while (start < list.size())
+    {
+        size_t end = list.find(';', start);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string entry = list.substr(start, end - start);
+        start = end + 1;
+        if (entry.empty())
+            continue;
+
+        FocuserPreset preset;
+        int reverse = 0, used = 0;
+        size_t separator = entry.find('=');
+        if (separator == 0 || separator == std::string::npos || parsed.size() >= MAX_PRESETS)
+            return false;
+        preset.name = entry.substr(0, separator);
+        if (sscanf(entry.c_str() + separator + 1, "%lf,%lf,%lf,%lf,%lf,%lf,%i,%lf,%i%n",
+                   &preset.settings[FS_SPEED], &preset.settings[FS_CURRENT], &preset.settings[FS_HOLD],
+                   &preset.settings[FS_STEP_SIZE], &preset.settings[FS_COMPENSATION], &preset.settings[FS_COMP_THRESHOLD],
+                   &preset.mode, &preset.maxPosition, &reverse, &used) != 9 || entry[separator + 1 + used] != '\0')
+            return false;
+        if (preset.mode < 0 || preset.mode >= Focuser1ModeSP.nsp)
+            return false;
+        // both focusers share the limits of the settings vector
+        for (int i = 0; i < FS_COUNT; i++)
+        {
+            if (preset.settings[i] < Focuser1SettingsN[i].min || preset.settings[i] > Focuser1SettingsN[i].max)
+            {
+                LOGF_ERROR("Preset '%s': %s out of range.", preset.name.c_str(), Focuser1SettingsN[i].label);
+                return false;
+            }
+        }
+        if (preset.maxPosition < FocusMaxPosNP[0].getMin() || preset.maxPosition > FocusMaxPosNP[0].getMax())
+        {
+            LOGF_ERROR("Preset '%s': maximum position out of range.", preset.name.c_str());
+            return false;
+        }
+        preset.reverse = reverse != 0;
+        parsed.push_back(preset);
+    }
+    return true;
+}
+
+void IndiAstroLink4mini2::publishPresets(IPState state)
+{
+    std::string list;
+    for (const auto &preset : presets)
+    {
+        char entry[MAXRBUF];
+        snprintf(entry, sizeof(entry), "%s=%g,%g,%g,%g,%g,%g,%i,%.0f,%i;", preset.name.c_str(),
+                 preset.settings[FS_SPEED], preset.settings[FS_CURRENT], preset.settings[FS_HOLD],
+                 preset.settings[FS_STEP_SIZE], preset.settings[FS_COMPENSATION], preset.settings[FS_COMP_THRESHOLD],
+                 preset.mode, preset.maxPosition, preset.reverse ? 1 : 0);
+        list += entry;
+    }
+    IUSaveText(&PresetsT[0], list.c_str());
+    PresetsTP.s = state;
+    IDSetText(&PresetsTP, nullptr);
+}
+
+bool IndiAstroLink4mini2::handleMotionTracking(ISState *states, char *names[], int n)
+{
+    IUUpdateSwitch(&MotionTrackSP, states, names, n);
+    MotionTrackSP.s = IPS_OK;
+    IDSetSwitch(&MotionTrackSP, nullptr);
+    return true;
+}
+
+bool IndiAstroLink4mini2::handleFocuserSelect(ISState *states, char *names[], int n)
+{
+    if (initComplete)
+    {
+        backlashPending = false;
+        motionProfiler.cancel();
+        if (focusSweep.active)
+            stopFocusSweep(IPS_ALERT);
+        setFindex((strcmp(FocuserSelectS[0].name, names[0])) ? 1 : 0);
+        DEBUGF(INDI::Logger::DBG_DEBUG, "Focuser index set by switch to %i", getFindex());
+        FocuserSelectSP.s  = IPS_BUSY;
+        IUUpdateSwitch(&FocuserSelectSP, states, names, n);
+        IDSetSwitch(&FocuserSelectSP, nullptr);
+        FocusMaxPosNP.setState(IPS_BUSY);
+        FocusMaxPosNP.apply();
+        FocusReverseSP.setState(IPS_BUSY);
+        FocusReverseSP.apply();
+        FocusAbsPosNP.setState(IPS_BUSY);
+        FocusAbsPosNP.apply();
+    }
+
+    return true;
+}
+
+bool IndiAstroLink4mini2::handleWeatherSafety(double values[], char *names[], int n)
+{
+    double previous[5];
+    for (int i = 0; i < 5; i++)
+        previous[i] = WeatherSafetyN[i].value;
+    IUUpdateNumber(&WeatherSafetyNP, values, names, n);
+
+    // swapped limits would invert the verdicts, so the pairs have to keep their order
+    if (!cloudFlag.configure(WeatherSafetyN[WS_CLOUDY].value, WeatherSafetyN[WS_CLEAR].value) ||
+            !dewFlag.configure(WeatherSafetyN[WS_DEW_UNSAFE].value, WeatherSafetyN[WS_DEW_SAFE].value))
+    {
+        LOG_ERROR("Safety limits rejected: clear has to be at or below cloudy, dew clear at or above dew risk.");
+        for (int i = 0; i < 5; i++)
+            WeatherSafetyN[i].value = previous[i];
+        // the cloud pair may have been taken before the dew pair failed
+        cloudFlag.configure(WeatherSafetyN[WS_CLOUDY].value, WeatherSafetyN[WS_CLEAR].value);
+        WeatherSafetyNP.s = IPS_ALERT;
+        IDSetNumber(&WeatherSafetyNP, nullptr);
+        return true;
+    }
+    for (auto &stats : weatherStats)
+        stats.setWindow(WeatherSafetyN[WS_WINDOW].value);
+    WeatherSafetyNP.s = IPS_OK;
+    IDSetNumber(&WeatherSafetyNP, nullptr);
+    return true;
+}
+
+bool IndiAstroLink4mini2::handleProtectionSettings(double values[], char *names[], int n)
+{
+    static_assert(static_cast<int>(PROT_OVERVOLTAGE) == PROT_FIELD_OVERVOLTAGE &&
+                  static_cast<int>(PROT_OVERCURRENT) == PROT_FIELD_OVERCURRENT &&
+                  static_cast<int>(PROT_OVERTIME) == PROT_FIELD_OVERTIME,
+                  "Protection settings layout");
+    SettingsUpdate update;
+    for (int i = 0; i < n; i++)
+    {
+        INumber *np = IUFindNumber(&ProtectionSettingsNP, names[i]);
+        if (np)
+            update.set(PROTECTION_FIELDS[np - ProtectionSettingsN], 0, values[i]);
+    }
+    if (updateSettings(update) != IPS_ALERT)
+    {
+        ProtectionSettingsNP.s = IPS_BUSY;
+        IUUpdateNumber(&ProtectionSettingsNP, values, names, n);
+        IDSetNumber(&ProtectionSettingsNP, nullptr);
+        return true;
+    }
+    ProtectionSettingsNP.s = IPS_ALERT;
+    IDSetNumber(&ProtectionSettingsNP, nullptr);
+    return true;
+}
+
+bool IndiAstroLink4mini2::handleProtectionPolling(ISState *states, char *names[], int n)
+{
+    IUUpdateSwitch(&ProtectionPollSP, states, names, n);
+    ProtectionPollSP.s = IPS_OK;
+    IDSetSwitch(&ProtectionPollSP, nullptr);
+    return true;
+}
+
+bool IndiAstroLink4mini2::handleMotionLogPath(char *texts[], char *names[], int n)
+{
+    // the vector has the file name only
+    const char *file = (n == 1) ? texts[0] : "";
+    if (!*file || strchr(file, '/') || strstr(file, ".."))
+    {
+        LOG_ERROR("Move log must be a plain file name.");
+        MotionLogPathTP.s = IPS_ALERT;
+        IDSetText(&MotionLogPathTP, nullptr);
+        return true;
+    }
+    IUUpdateText(&MotionLogPathTP, texts, names, n);
+    MotionLogPathTP.s = IPS_OK;
+    IDSetText(&MotionLogPathTP, nullptr);
+    return true;
+}
+
+std::string IndiAstroLink4mini2::motionLogPath() const
+{
+    const char *home = getenv("HOME");
+    return std::string(home ? home : "") + "/.indi/" + MotionLogPathT[0].text;
+}
+
+bool IndiAstroLink4mini2::handleMotionLog(ISState *states, char *names[], int n)
+{
+    IUUpdateSwitch(&MotionLogSP, states, names, n);
+    int action = IUFindOnSwitchIndex(&MotionLogSP);
+    IUResetSwitch(&MotionLogSP);
+    if (action == MP_LOG_EXPORT)
+    {
+        std::string path = motionLogPath();
+        bool exported = motionProfiler.exportLog(path.c_str());
+        MotionLogSP.s = exported ? IPS_OK : IPS_ALERT;
+        if (exported)
+            LOGF_INFO("Move log exported to %s", path.c_str());
+        else
+            LOGF_ERROR("Cannot write move log to %s", path.c_str());
+    }
+    else if (action == MP_LOG_CLEAR)
+    {
+        motionProfiler.clear();
+        updateMotionProfile();
+        MotionLogSP.s = IPS_OK;
+    }
+    IDSetSwitch(&MotionLogSP, nullptr);
+    return true;
+}
+
+bool IndiAstroLink4mini2::handleMetricsEndpoint(char *texts[], char *names[], int n)
+{
+    IUUpdateText(&MetricsEndpointTP, texts, names, n);
+    MetricsEndpointTP.s = IPS_OK;
+    IDSetText(&MetricsEndpointTP, nullptr);
+    if (metricsExporter.isRunning())
+        startMetrics();
+    return true;
+}
+
+bool IndiAstroLink4mini2::handleMetrics(ISState *states, char *names[], int n)
+{
+    IUUpdateSwitch(&MetricsSP, states, names, n);
+    if (MetricsS[METRICS_ENABLE].s == ISS_ON)
+    {
+        startMetrics();
+    }
+    else
+    {
+        metricsExporter.stop();
+        MetricsSP.s = IPS_IDLE;
+        IDSetSwitch(&MetricsSP, nullptr);
+    }
+    return true;
+}
+
+void IndiAstroLink4mini2::startMetrics()
+{
+    std::string error;
+    if (metricsExporter.start(MetricsEndpointT[0].text, error))
+    {
+        LOGF_INFO("Metrics exporter listening on %s", MetricsEndpointT[0].text);
+        MetricsSP.s = IPS_OK;
+    }
+    else
+    {
+        LOGF_ERROR("Cannot start metrics exporter on %s: %s", MetricsEndpointT[0].text, error.c_str());
+        MetricsSP.s = IPS_ALERT;
+    }
+    IDSetSwitch(&MetricsSP, nullptr);
+}
+
+void IndiAstroLink4mini2::renderMetrics(std::string &out)
+{
+    static const char *const index[] = {"1", "2", "3"};
+    const DeviceState &state = deviceState();
+    bool sampled = isConnected() && linkState != LINK_DOWN && state.sequence > 0;
+    MetricsWriter metrics(out);
+
+    metrics.family("astrolink4_up", "gauge", nullptr, "Device connected and reporting status");
+    metrics.sample("astrolink4_up", sampled ? 1 : 0);
+    metrics.family("astrolink4_command_errors", "counter", nullptr, "Failed or unexpected command replies");
+    metrics.sample("astrolink4_command_errors", commandErrors);
+    metrics.family("astrolink4_frame_errors", "counter", nullptr, "Status frames that could not be decoded");
+    metrics.sample("astrolink4_frame_errors", frameErrors);
+    metrics.family("astrolink4_motion_queries", "counter", nullptr, "Short position queries polled in place of a status frame");
+    metrics.sample("astrolink4_motion_queries", motionQueries);
+    metrics.family("astrolink4_poll_overruns", "counter", nullptr, "Poll ticks skipped because the previous tick ran late");
+    metrics.sample("astrolink4_poll_overruns", pollOverruns);
+    metrics.family("astrolink4_link_lost", "counter", nullptr, "Times the controller stopped responding");
+    metrics.sample("astrolink4_link_lost", linkTrips);
+    if (!sampled)
+    {
+        metrics.finish();
+        return;
+    }
+
+    metrics.family("astrolink4_sample_timestamp_seconds", "gauge", "seconds", "Time the status frame was sampled");
+    metrics.sample("astrolink4_sample_timestamp_seconds", state.wallTime);
+    metrics.family("astrolink4_command_latency_seconds", "gauge", "seconds", "Status query round trip over the statistics window");
+    metrics.sample("astrolink4_command_latency_seconds", "stat", "mean", pollLatency.mean() / 1000.0);
+    metrics.sample("astrolink4_command_latency_seconds", "stat", "max", pollLatency.max() / 1000.0);
+
+    metrics.family("astrolink4_focuser_position_steps", "gauge", "steps", "Focuser position");
+    metrics.sample("astrolink4_focuser_position_steps", "focuser", index[0], state.position[0]);
+    metrics.sample("astrolink4_focuser_position_steps", "focuser", index[1], state.position[1]);
+    metrics.family("astrolink4_focuser_to_go_steps", "gauge", "steps", "Steps left in the running move");
+    metrics.sample("astrolink4_focuser_to_go_steps", "focuser", index[0], state.stepsToGo[0]);
+    metrics.sample("astrolink4_focuser_to_go_steps", "focuser", index[1], state.stepsToGo[1]);
+    if (!state.extended)
+    {
+        metrics.finish();
+        return;
+    }
+
+    metrics.family("astrolink4_input_voltage_volts", "gauge", "volts", "Input voltage");
+    metrics.sample("astrolink4_input_voltage_volts", state.vin);
+    metrics.family("astrolink4_regulated_voltage_volts", "gauge", "volts", "Regulated output voltage");
+    metrics.sample("astrolink4_regulated_voltage_volts", state.vreg);
+    metrics.family("astrolink4_current_amperes", "gauge", "amperes", "Total current");
+    metrics.sample("astrolink4_current_amperes", state.current);
+    metrics.family("astrolink4_charge_ampere_hours", "gauge", "ampere_hours", "Charge consumed since power on");
+    metrics.sample("astrolink4_charge_ampere_hours", state.ah);
+    metrics.family("astrolink4_energy_watt_hours", "gauge", "watt_hours", "Energy consumed since power on");
+    metrics.sample("astrolink4_energy_watt_hours", state.wh);
+    metrics.family("astrolink4_protection_fault", "gauge", nullptr, "Protection fault type, 0 when none");
+    metrics.sample("astrolink4_protection_fault", state.overType);
+
+    metrics.family("astrolink4_pwm_duty_percent", "gauge", "percent", "PWM output duty cycle");
+    metrics.sample("astrolink4_pwm_duty_percent", "output", index[0], state.pwm[0]);
+    metrics.sample("astrolink4_pwm_duty_percent", "output", index[1], state.pwm[1]);
+    metrics.family("astrolink4_output_on", "gauge", nullptr, "Power output switched on");
+    for (int i = 0; i < 3; i++)
+        metrics.sample("astrolink4_output_on", "output", index[i], state.output[i] ? 1 : 0);
+
+    if (state.sensors & (SENSOR_SENS1 | SENSOR_SENS2 | SENSOR_SENS2E | SENSOR_MLX))
+    {
+        metrics.family("astrolink4_temperature_celsius", "gauge", "celsius", "Sensor temperatures");
+        if (state.sensors & SENSOR_SENS1)
+        {
+            metrics.sample("astrolink4_temperature_celsius", "sensor", "ambient", state.sens1Temp);
+            metrics.sample("astrolink4_temperature_celsius", "sensor", "dewpoint", state.sens1Dew);
+        }
+        if (state.sensors & SENSOR_SENS2)
+            metrics.sample("astrolink4_temperature_celsius", "sensor", "probe", state.sens2Temp);
+        if (state.sensors & SENSOR_SENS2E)
+        {
+            metrics.sample("astrolink4_temperature_celsius", "sensor", "ambient2", state.sens2eTemp);
+            metrics.sample("astrolink4_temperature_celsius", "sensor", "dewpoint2", state.sens2eDew);
+        }
+        if (state.sensors & SENSOR_MLX)
+        {
+            metrics.sample("astrolink4_temperature_celsius", "sensor", "sky", state.mlxTemp);
+            metrics.sample("astrolink4_temperature_celsius", "sensor", "sky_ambient", state.mlxAux);
+        }
+    }
+    if (state.sensors & (SENSOR_SENS1 | SENSOR_SENS2E))
+    {
+        metrics.family("astrolink4_humidity_percent", "gauge", "percent", "Relative humidity");
+        if (state.sensors & SENSOR_SENS1)
+            metrics.sample("astrolink4_humidity_percent", "sensor", "ambient", state.sens1Hum);
+        if (state.sensors & SENSOR_SENS2E)
+            metrics.sample("astrolink4_humidity_percent", "sensor", "ambient2", state.sens2eHum);
+    }
+    if (state.sensors & SENSOR_SBM)
+    {
+        metrics.family("astrolink4_sky_brightness_mag_arcsec2", "gauge", "mag_arcsec2", "Sky brightness with the SQM offset applied");
+        metrics.sample("astrolink4_sky_brightness_mag_arcsec2", state.sbm + SQMOffsetN[0].value);
+    }
+    metrics.finish();
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Focuser interface
+//////////////////////////////////////////////////////////////////////
+IPState IndiAstroLink4mini2::MoveAbsFocuser(uint32_t targetTicks)
+{
+    if (focusSweep.active)
+    {
+        LOG_ERROR("Focus sweep in progress, abort it first.");
+        return IPS_ALERT;
+    }
+    int current = freshState().position[getFindex()];
+    int direction = (static_cast<int>(targetTicks) > current) ? 1 : (static_cast<int>(targetTicks) < current) ? -1 : 0;
+    int &approach = approachDirection[getFindex()];
+    backlashPending = false;
+
+    // On reversal go past the target and come back, so the target is always
+    // approached from the same side. The return leg is chained from readDevice.
+    if (backlashEnabled && backlashSteps != 0 && direction != 0 && approach != 0 && direction != approach)
+    {
+        int64_t overshoot = static_cast<int64_t>(targetTicks) + direction * std::abs(backlashSteps);
+        overshoot = std::max<int64_t>(0, std::min<int64_t>(overshoot, FocusMaxPosNP[0].getValue()));
+        if (!startMove(overshoot))
+            return IPS_ALERT;
+        backlashPending = true;
+        backlashHeld = false;
+        backlashTarget = targetTicks;
+        DEBUGF(INDI::Logger::DBG_DEBUG, "Backlash compensation, overshoot to %i then return to %u", static_cast<int>(overshoot), targetTicks);
+        return IPS_BUSY;
+    }
+
+    if (!startMove(targetTicks))
+        return IPS_ALERT;
+    if (direction != 0 && approach == 0)
+        approach = direction;
+    return IPS_BUSY;
+}
+
+bool IndiAstroLink4mini2::startMove(uint32_t targetTicks)
+{
+    char cmd[ASTROLINK4_LEN] = {0}, res[ASTROLINK4_LEN] = {0};
+    snprintf(cmd, ASTROLINK4_LEN, "R:%i:%u", getFindex(), targetTicks);
+    if (!sendCommand(cmd, res))
+        return false;
+    moveTarget[getFindex()] = targetTicks;
+    moving = true;
+    // the first poll of a move reads the full frame, the distance left comes from there
+    lastFullStatus = 0;
+    motionProfiler.begin(getFindex(), monotonicNow(), deviceState().position[getFindex()], targetTicks);
+    return true;
+}
+
+IPState IndiAstroLink4mini2::MoveRelFocuser(FocusDirection dir, uint32_t ticks)
+{
+    int base = focuserTarget();
+    int target = (dir == FOCUS_INWARD) ? base - static_cast<int>(ticks) : base + static_cast<int>(ticks);
+    return MoveAbsFocuser(std::max(0, target));
+}
+
+bool IndiAstroLink4mini2::AbortFocuser()
+{
+    char cmd[ASTROLINK4_LEN] = {0}, res[ASTROLINK4_LEN] = {0};
+    snprintf(cmd, ASTROLINK4_LEN, "H:%i", getFindex());
+    motionProfiler.cancel();
+    backlashPending = false;
+    if (focusSweep.active)
+        stopFocusSweep(IPS_IDLE);
+    return (sendCommand(cmd, res));
+}
+
+bool IndiAstroLink4mini2::ReverseFocuser(bool enabled)
+{
+    SettingsUpdate update;
+    update.set(FOCUSER_REVERSE_FIELD, getFindex(), enabled ? 1 : 0);
+    if (updateSettings(update) != IPS_ALERT)
+    {
+        FocusReverseSP.setState(IPS_BUSY);
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+bool IndiAstroLink4mini2::SyncFocuser(uint32_t ticks)
+{
+    char cmd[ASTROLINK4_LEN] = {0}, res[ASTROLINK4_LEN] = {0};
+    snprintf(cmd, ASTROLINK4_LEN, "P:%i:%u", getFindex(), ticks);
+    if (sendCommand(cmd, res))
+    {
+        FocusAbsPosNP.setState(IPS_BUSY);
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+bool IndiAstroLink4mini2::SetFocuserMaxPosition(uint32_t ticks)
+{
+    SettingsUpdate update;
+    update.set(FOCUSER_MAX_FIELD, getFindex(), ticks);
+    if (updateSettings(update) != IPS_ALERT)
+    {
+        FocusMaxPosNP.setState(IPS_BUSY);
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+bool IndiAstroLink4mini2::SetFocuserBacklash(int32_t steps)
+{
+    backlashSteps = steps;
+    return true;
+}
+
+bool IndiAstroLink4mini2::SetFocuserBacklashEnabled(bool enabled)
+{
+    backlashEnabled = enabled;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Focus sweep
+//////////////////////////////////////////////////////////////////////
+bool IndiAstroLink4mini2::handleFocusSweep(double values[], char *names[], int n)
+{
+    if (focusSweep.active)
+    {
+        LOG_ERROR("Focus sweep in progress, abort it first.");
+        IDSetNumber(&FocusSweepNP, nullptr);
+        return true;
+    }
+
+    IUUpdateNumber(&FocusSweepNP, values, names, n);
+    int start = FocusSweepN[SWEEP_START].value;
+    int step = FocusSweepN[SWEEP_STEP].value;
+    int count = FocusSweepN[SWEEP_COUNT].value;
+    int approach = FocusSweepN[SWEEP_APPROACH].value;
+    int last = start + (count - 1) * step;
+    if (count < 1 || (step == 0 && count > 1) || last < 0 || std::max(start, last) > FocusMaxPosNP[0].getValue())
+    {
+        LOG_ERROR("Focus sweep points out of the focuser range.");
+        FocusSweepNP.s = IPS_ALERT;
+        IDSetNumber(&FocusSweepNP, nullptr);
+        return true;
+    }
+
+    // every point, the first one included, is reached moving in the sweep direction
+    int direction = (step < 0) ? -1 : 1;
+    focusSweep = {true, getFindex(), 0, count, start, step, FocusSweepN[SWEEP_DWELL].value, approach > 0, false, false, 0};
+    backlashPending = false;
+    if (!startSweepMove(approach > 0 ? start - direction * approach : start))
+    {
+        focusSweep.active = false;
+        LOG_ERROR("Focus sweep move failed.");
+        FocusSweepNP.s = IPS_ALERT;
+        IDSetNumber(&FocusSweepNP, nullptr);
+        return true;
+    }
+    approachDirection[getFindex()] = direction;
+
+    for (auto &text : FocusSweepPointT)
+        IUSaveText(&text, "");
+    FocusSweepPointTP.s = IPS_IDLE;
+    IDSetText(&FocusSweepPointTP, nullptr);
+    FocusSweepNP.s = IPS_BUSY;
+    IDSetNumber(&FocusSweepNP, nullptr);
+    LOGF_INFO("Focus sweep started, %i points from %i by %i steps", count, start, step);
+    return true;
+}
+
+bool IndiAstroLink4mini2::handleFocusSweepControl(ISState *states, char *names[], int n)
+{
+    IUUpdateSwitch(&FocusSweepControlSP, states, names, n);
+    int action = IUFindOnSwitchIndex(&FocusSweepControlSP);
+    IUResetSwitch(&FocusSweepControlSP);
+    FocusSweepControlSP.s = IPS_OK;
+    if (!focusSweep.active)
+    {
+        FocusSweepControlSP.s = IPS_IDLE;
+    }
+    else if (action == SWEEP_NEXT)
+    {
+        // only a point that was reached can be left, a move in progress is never cut short
+        if (focusSweep.settled)
+            focusSweep.advance = true;
+        else
+            LOG_WARN("Focus sweep is still moving to the next point.");
+    }
+    else if (action == SWEEP_ABORT)
+    {
+        AbortFocuser();
+        LOG_INFO("Focus sweep aborted.");
+    }
+    IDSetSwitch(&FocusSweepControlSP, nullptr);
+    return true;
+}
+
+bool IndiAstroLink4mini2::startSweepMove(int target)
+{
+    target = std::max(0, std::min(target, static_cast<int>(FocusMaxPosNP[0].getValue())));
+    if (!startMove(target))
+        return false;
+    FocusAbsPosNP.setState(IPS_BUSY);
+    FocusAbsPosNP.apply();
+    return true;
+}
+
+void IndiAstroLink4mini2::stopFocusSweep(IPState state)
+{
+    focusSweep.active = false;
+    FocusSweepNP.s = state;
+    queueSet(&FocusSweepNP);
+}
+
+void IndiAstroLink4mini2::runFocusSweep(const DeviceState &state)
+{
+    if (state.stepsToGo[focusSweep.focuser] != 0)
+        return;
+
+    if (focusSweep.approaching)
+    {
+        focusSweep.approaching = false;
+        if (!startSweepMove(focusSweep.start))
+        {
+            LOG_ERROR("Focus sweep move failed.");
+            stopFocusSweep(IPS_ALERT);
+        }
+        return;
+    }
+
+    if (!focusSweep.settled)
+    {
+        focusSweep.settled = true;
+        focusSweep.reachedAt = state.timestamp;
+
+        char index[16], position[16], timestamp[32];
+        time_t seconds = static_cast<time_t>(state.wallTime);
+        snprintf(index, sizeof(index), "%i/%i", focusSweep.point + 1, focusSweep.count);
+        snprintf(position, sizeof(position), "%i", state.position[focusSweep.focuser]);
+        size_t used = strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", gmtime(&seconds));
+        snprintf(timestamp + used, sizeof(timestamp) - used, ".%03d", static_cast<int>((state.wallTime - seconds) * 1000.0));
+        IUSaveText(&FocusSweepPointT[SWEEP_POINT_INDEX], index);
+        IUSaveText(&FocusSweepPointT[SWEEP_POINT_POSITION], position);
+        IUSaveText(&FocusSweepPointT[SWEEP_POINT_TIME], timestamp);
+        FocusSweepPointTP.s = IPS_OK;
+        queueSet(&FocusSweepPointTP);
+        DEBUGF(INDI::Logger::DBG_DEBUG, "Focus sweep point %s reached at %s", index, position);
+
+        if (focusSweep.point + 1 == focusSweep.count)
+        {
+            stopFocusSweep(IPS_OK);
+            LOG_INFO("Focus sweep complete.");
+        }
+        return;
+    }
+
+    bool dwellDone = focusSweep.dwell > 0 && state.timestamp - focusSweep.reachedAt >= focusSweep.dwell;
+    if (!dwellDone && !focusSweep.advance)
+        return;
+    focusSweep.point++;
+    focusSweep.settled = false;
+    focusSweep.advance = false;
+    if (!startSweepMove(focusSweep.start + focusSweep.point * focusSweep.step))
+    {
+        LOG_ERROR("Focus sweep move failed.");
+        stopFocusSweep(IPS_ALERT);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Camera guard
+//////////////////////////////////////////////////////////////////////
+bool IndiAstroLink4mini2::handleCameraGuard(char *texts[], char *names[], int n)
+{
+    IUUpdateText(&CameraGuardTP, texts, names, n);
+    exposureBusy = false;
+    if (*CameraGuardT[0].text)
+        IDSnoopDevice(CameraGuardT[0].text, "CCD_EXPOSURE");
+    CameraGuardTP.s = IPS_OK;
+    IDSetText(&CameraGuardTP, nullptr);
+    publishCameraGuard();
+    return true;
+}
+
+bool IndiAstroLink4mini2::handleCameraGuardMode(ISState *states, char *names[], int n)
+{
+    IUUpdateSwitch(&CameraGuardModeSP, states, names, n);
+    CameraGuardModeSP.s = IPS_OK;
+    IDSetSwitch(&CameraGuardModeSP, nullptr);
+    return true;
+}
+
+bool IndiAstroLink4mini2::handleCameraGuardSettings(double values[], char *names[], int n)
+{
+    IUUpdateNumber(&CameraGuardNP, values, names, n);
+    CameraGuardNP.s = IPS_OK;
+    IDSetNumber(&CameraGuardNP, nullptr);
+    return true;
+}
+
+bool IndiAstroLink4mini2::exposureActive() const
+{
+    return CameraGuardModeS[GUARD_OFF].s != ISS_ON && exposureBusy && monotonicNow() - exposureSeen < GUARD_STALE;
+}
+
+bool IndiAstroLink4mini2::readoutActive() const
+{
+    return exposureActive() && exposureRemaining <= CameraGuardN[GUARD_READOUT].value;
+}
+
+bool IndiAstroLink4mini2::guardSkipsPoll(double now)
+{
+    // a protection fault is tracked at the usual cadence regardless
+    if (!readoutActive() || protectionType > 0)
+        return false;
+    if (CameraGuardModeS[GUARD_THIN].s == ISS_ON && now - lastGuardedPoll >= CameraGuardN[GUARD_THIN_PERIOD].value)
+    {
+        lastGuardedPoll = now;
+        return false;
+    }
+    guardSkipped++;
+    publishCameraGuard();
+    return true;
+}
+
+void IndiAstroLink4mini2::flushDeferredSettings()
+{
+    // on success the properties stay BUSY, the settings read back later in this poll confirms them
+    bool written = writeSettings(deferredSettings);
+    deferredSettings.clear();
+    if (written)
+    {
+        LOG_INFO("Settings deferred during the exposure written.");
+        return;
+    }
+
+    LOG_ERROR("Deferred settings write failed.");
+    for (const auto &entry : properties)
+    {
+        if (entry.refresh != REFRESH_SETTINGS || entry.state() != IPS_BUSY)
+            continue;
+        if (entry.number)
+        {
+            entry.number->s = IPS_ALERT;
+            queueSet(entry.number);
+        }
+        else if (entry.switches)
+        {
+            entry.switches->s = IPS_ALERT;
+            queueSet(entry.switches);
+        }
+    }
+    if (FocusMaxPosNP.getState() == IPS_BUSY)
+    {
+        FocusMaxPosNP.setState(IPS_ALERT);
+        queueSet(FocusMaxPosNP);
+    }
+    if (FocusReverseSP.getState() == IPS_BUSY)
+    {
+        FocusReverseSP.setState(IPS_ALERT);
+        queueSet(FocusReverseSP);
+    }
+}
+
+void IndiAstroLink4mini2::publishCameraGuard()
+{
+    CameraGuardStatusN[GUARD_EXPOSING].value = exposureActive() ? 1 : 0;
+    CameraGuardStatusN[GUARD_SKIPPED].value = guardSkipped;
+    CameraGuardStatusN[GUARD_DEFERRED].value = guardDeferred;
+    CameraGuardStatusN[GUARD_HELD].value = guardHeld;
+    CameraGuardStatusNP.s = exposureActive() ? IPS_BUSY : IPS_IDLE;
+    queueSet(&CameraGuardStatusNP);
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Serial commands
+//////////////////////////////////////////////////////////////////////
+bool IndiAstroLink4mini2::sendCommand(const char *cmd, char *res)
+{
+    if (!linkAvailable())
+        return false;
+
+    DEBUGF(INDI::Logger::DBG_DEBUG, "CMD %s", cmd);
+    int tty_rc = transport->transact(cmd, res, ASTROLINK4_LEN, commandTimeout());
+    recordLinkResult(tty_rc);
+    if (tty_rc != TTY_OK)
+    {
+        char errorMessage[MAXRBUF];
+        tty_error_msg(tty_rc, errorMessage, MAXRBUF);
+        LOGF_ERROR("Communication error (%s): %s", transport->name(), errorMessage);
+        commandErrors++;
+        return false;
+    }
+
+    // any command but a query may change what the last status frame reported
+    if (strchr("RCBPHU", cmd[0]))
+        stateStale = true;
+    if (!res)
+        return true;
+    DEBUGF(INDI::Logger::DBG_DEBUG, "RES %s", res);
+    if (cmd[0] != res[0])
+    {
+        commandErrors++;
+        return false;
+    }
+    return true;
+}
+
+bool IndiAstroLink4mini2::sendBatch(const char *const cmds[], char *const res[], int count)
+{
+    if (!linkAvailable())
+        return false;
+
+    for (int i = 0; i < count; i++)
+        DEBUGF(INDI::Logger::DBG_DEBUG, "CMD %s", cmds[i]);
+    int tty_rc = transport->transactBatch(cmds, res, count, ASTROLINK4_LEN, commandTimeout());
+    recordLinkResult(tty_rc);
+    stateStale = true;
+    if (tty_rc != TTY_OK)
+    {
+        char errorMessage[MAXRBUF];
+        tty_error_msg(tty_rc, errorMessage, MAXRBUF);
+        LOGF_ERROR("Communication error (%s): %s", transport->name(), errorMessage);
+        commandErrors++;
+        return false;
+    }
+
+    bool allOk = true;
+    for (int i = 0; i < count; i++)
+    {
+        DEBUGF(INDI::Logger::DBG_DEBUG, "RES %s", res[i]);
+        if (cmds[i][0] != res[i][0])
+        {
+            commandErrors++;
+            allOk = false;
+        }
+    }
+    return allOk;
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Link health
+//////////////////////////////////////////////////////////////////////
+bool IndiAstroLink4mini2::linkAvailable()
+{
+    if (!transport)
+    {
+        linkError = TTY_PORT_FAILURE;
+        return false;
+    }
+    // with the breaker open nothing but the probe and the handshake of a reopened port
+    // goes out, so handlers fail at once
+    return linkState != LINK_DOWN || probing || reconnecting;
+}
+
+int IndiAstroLink4mini2::commandTimeout() const
+{
+    // once a command went unanswered the rest is only given a short time to confirm
+    // the link is dead, a reopened port gets the full time as the controller may restart
+    return (linkFailures > 0 && !reconnecting) ? LINK_PROBE_TIMEOUT : ASTROLINK4_TIMEOUT * 1000;
+}
+
+void IndiAstroLink4mini2::recordLinkResult(int tty_rc)
+{
+    linkError = tty_rc;
+    if (tty_rc == TTY_OK)
+    {
+        if (linkFailures > 0)
+        {
+            linkFailures = 0;
+            publishLinkHealth();
+        }
+        return;
+    }
+
+    linkFailures++;
+    if (linkState == LINK_UP && linkFailures >= LINK_TRIP_FAILURES)
+        openBreaker();
+    else
+        publishLinkHealth();
+}
+
+void IndiAstroLink4mini2::openBreaker()
+{
+    linkState = LINK_DOWN;
+    linkTrips++;
+    linkBackoff = LINK_BACKOFF_MIN;
+    nextProbe = monotonicNow() + linkBackoff;
+    LOGF_ERROR("Controller is not responding, retrying in %.0f s.", linkBackoff);
+
+    // nothing in flight can complete
+    motionProfiler.cancel();
+    backlashPending = false;
+    if (focusSweep.active)
+        stopFocusSweep(IPS_ALERT);
+
+    // every property that mirrors the device goes to alert until it is read again
+    for (const auto &entry : properties)
+    {
+        if (entry.refresh == REFRESH_NONE)
+            continue;
+        if (entry.number)
+        {
+            entry.number->s = IPS_ALERT;
+            queueSet(entry.number);
+        }
+        else if (entry.switches)
+        {
+            entry.switches->s = IPS_ALERT;
+            queueSet(entry.switches);
+        }
+        else if (entry.text)
+        {
+            entry.text->s = IPS_ALERT;
+            queueSet(entry.text);
+        }
+        else
+        {
+            entry.lights->s = IPS_ALERT;
+            queueSet(entry.lights);
+        }
+    }
+    FocusAbsPosNP.setState(IPS_ALERT);
+    queueSet(FocusAbsPosNP);
+    FocusRelPosNP.setState(IPS_ALERT);
+    queueSet(FocusRelPosNP);
+    FocusMaxPosNP.setState(IPS_ALERT);
+    queueSet(FocusMaxPosNP);
+    FocusReverseSP.setState(IPS_ALERT);
+    queueSet(FocusReverseSP);
+    publishLinkHealth();
+}
+
+void IndiAstroLink4mini2::probeLink()
+{
+    char res[ASTROLINK4_LEN] = {0};
+    probing = true;
+    bool restored = sendCommand("#", res) && strncmp(res, "#:AstroLink4mini", 16) == 0;
+    // the port itself failed, e.g. the adapter was unplugged, so it is opened again
+    if (!restored && linkError != TTY_TIME_OUT)
+        restored = reopenConnection();
+    probing = false;
+
+    if (restored)
+        linkRestored();
+    else
+    {
+        linkBackoff = std::min(linkBackoff * 2.0, LINK_BACKOFF_MAX);
+        nextProbe = monotonicNow() + linkBackoff;
+        DEBUGF(INDI::Logger::DBG_DEBUG, "Controller still not responding, retrying in %.0f s", linkBackoff);
+    }
+    publishLinkHealth();
+}
+
+bool IndiAstroLink4mini2::reopenConnection()
+{
+    Connection::Interface *connection = getActiveConnection();
+    LOGF_INFO("Reopening %s connection.", connection->name().c_str());
+    transport.reset();
+    reconnecting = true;
+    connection->Disconnect();
+    bool restored = connection->Connect();
+    reconnecting = false;
+    linkReconnects++;
+    if (!restored)
+        transport.reset();
+    return restored;
+}
+
+void IndiAstroLink4mini2::linkRestored()
+{
+    linkState = LINK_UP;
+    linkFailures = 0;
+    linkBackoff = 0;
+    // force the protection state to be published again
+    protectionType = -1;
+    stateStale = true;
+    LOG_INFO("Controller link restored.");
+}
+
+bool IndiAstroLink4mini2::handleHotplug(ISState *states, char *names[], int n)
+{
+    IUUpdateSwitch(&HotplugSP, states, names, n);
+    if (isConnected())
+    {
+        startHotplug();
+    }
+    else
+    {
+        HotplugSP.s = IPS_OK;
+        IDSetSwitch(&HotplugSP, nullptr);
+    }
+    return true;
+}
+
+void IndiAstroLink4mini2::startHotplug()
+{
+    portWatcher.stop();
+    portRemoved = false;
+    std::string link, error;
+    if (HotplugS[HOTPLUG_ENABLE].s != ISS_ON || isSimulation() || getActiveConnection() != serialConnection)
+    {
+        HotplugSP.s = IPS_IDLE;
+    }
+    else if ((link = PortWatcher::stableLink(serialConnection->port())).empty())
+    {
+        LOGF_WARN("%s has no /dev/serial/by-id link, hot plug is not watched.", serialConnection->port());
+        HotplugSP.s = IPS_ALERT;
+    }
+    else if (!portWatcher.start(link, error))
+    {
+        LOGF_ERROR("Cannot watch %s: %s", link.c_str(), error.c_str());
+        HotplugSP.s = IPS_ALERT;
+    }
+    else
+    {
+        DEBUGF(INDI::Logger::DBG_DEBUG, "Watching %s", link.c_str());
+        HotplugSP.s = IPS_OK;
+    }
+    IUSaveText(&HotplugT[0], portWatcher.isWatching() ? link.c_str() : "");
+    HotplugTP.s = HotplugSP.s;
+    IDSetSwitch(&HotplugSP, nullptr);
+    IDSetText(&HotplugTP, nullptr);
+}
+
+void IndiAstroLink4mini2::onPortChange(bool present)
+{
+    if (!present)
+    {
+        // no reason to wait for timeouts to pile up
+        LOG_WARN("Controller unplugged.");
+        portRemoved = true;
+        if (linkState != LINK_DOWN)
+            openBreaker();
+        publishLinkHealth();
+        return;
+    }
+
+    LOG_INFO("Controller plugged in.");
+    portRemoved = false;
+    if (linkState != LINK_DOWN)
+        return;
+
+    // the tty may have a new name, the port follows the stable link from now on and
+    // auto search would only try other ports when the node is not ready yet
+    char *texts[1] = {const_cast<char *>(portWatcher.path().c_str())};
+    char *names[1] = {const_cast<char *>("PORT")};
+    serialConnection->ISNewText(getDeviceName(), "DEVICE_PORT", texts, names, 1);
+    ISState states[1] = {ISS_ON};
+    char *search[1] = {const_cast<char *>("INDI_DISABLED")};
+    serialConnection->ISNewSwitch(getDeviceName(), "DEVICE_AUTO_SEARCH", states, search, 1);
+    if (reopenConnection())
+    {
+        linkRestored();
+    }
+    else
+    {
+        // udev may not have finished with the node yet, probes take over
+        linkBackoff = LINK_BACKOFF_MIN;
+        nextProbe = monotonicNow() + linkBackoff;
+    }
+    publishLinkHealth();
+}
+
+void IndiAstroLink4mini2::publishLinkHealth()
+{
+    LinkHealthN[LINK_FAILURES].value = linkFailures;
+    LinkHealthN[LINK_TRIPS].value = linkTrips;
+    LinkHealthN[LINK_RECONNECTS].value = linkReconnects;
+    LinkHealthN[LINK_RETRY].value = (linkState == LINK_DOWN) ? linkBackoff : 0;
+    LinkHealthNP.s = (linkState == LINK_DOWN) ? IPS_ALERT : (linkFailures > 0) ? IPS_BUSY : IPS_OK;
+    queueSet(&LinkHealthNP);
+}
+
+bool IndiAstroLink4mini2::queryStatus()
+{
+    char res[ASTROLINK4_LEN] = {0};
+    double requestTime = monotonicNow();
+    double requestWallTime = wallClockNow();
+    if (!sendCommand("q", res))
+        return false;
+
+    // the sample is stamped at the middle of the request/reply exchange
+    double latency = monotonicNow() - requestTime;
+    if (!commitStatus(res, requestTime + latency / 2.0, requestWallTime + latency / 2.0))
+        return false;
+    pollLatency.add(deviceState().timestamp, latency * 1000.0);
+    lastFullStatus = requestTime;
+    return true;
+}
 
-        if (result.size() > 5)
+bool IndiAstroLink4mini2::motionTracking()
+{
+    // a held backlash return leg waits for a camera, nothing to follow at a high rate
+    return moving && !backlashHeld && motionQuerySupported && MotionTrackS[MOTION_TRACK_ENABLE].s == ISS_ON &&
+           protectionType <= 0;
+}
+
+bool IndiAstroLink4mini2::queryMotion()
+{
+    int index = getFindex();
+    char position[ASTROLINK4_LEN] = {0}, motion[ASTROLINK4_LEN] = {0};
+    char positionCmd[8], motionCmd[8];
+    snprintf(positionCmd, sizeof(positionCmd), "p:%i", index);
+    snprintf(motionCmd, sizeof(motionCmd), "i:%i", index);
+    const char *const cmds[2] = {positionCmd, motionCmd};
+    char *const res[2] = {position, motion};
+
+    double requestTime = monotonicNow();
+    double requestWallTime = wallClockNow();
+    bool sent = sendBatch(cmds, res, 2);
+    double latency = monotonicNow() - requestTime;
+
+    // the "p:<steps>" and "i:<0|1>" replies are not in every firmware, one that answers
+    // them differently is followed with the full frame for the rest of the connection
+    double value, busy;
+    if (!sent || position[1] != ':' || motion[1] != ':' || !parseField(position + 2, value) || !parseField(motion + 2, busy))
+    {
+        if (position[0] && motion[0])
         {
-            if (std::stoi(result[Q_SENS1_PRESENT]) > 0)
-            {
-                setParameterValue("WEATHER_TEMPERATURE", std::stod(result[Q_SENS1_TEMP]));
-                setParameterValue("WEATHER_HUMIDITY", std::stod(result[Q_SENS1_HUM]));
-                setParameterValue("WEATHER_DEWPOINT", std::stod(result[Q_SENS1_DEW]));
-            }
-            else
-            {
-                setParameterValue("WEATHER_TEMPERATURE", 0.0);
-                setParameterValue("WEATHER_HUMIDITY", 0.0);
-                setParameterValue("WEATHER_DEWPOINT", 0.0);
-                
-            }       
-            if (std::stoi(result[Q_MLX_PRESENT]) > 0)
-            {
-                setParameterValue("WEATHER_SKY_TEMP", std::stod(result[Q_MLX_TEMP]));
-                setParameterValue("WEATHER_SKY_DIFF", std::stod(result[Q_MLX_TEMP]) - std::stod(result[Q_MLX_AUX]));     
-            }
-            else
-            {
-                setParameterValue("WEATHER_SKY_TEMP", 0.0);
-                setParameterValue("WEATHER_SKY_DIFF", 0.0);              
-            }
-            if (std::stoi(result[Q_SBM_PRESENT]) > 0)
-            {
-                setParameterValue("SQM_READING", std::stod(result[Q_SBM]) + SQMOffsetN[0].value);
-            }
-            else
-            {
-                setParameterValue("SQM_READING", 0.0);
-            }                 
+            LOGF_WARN("Unexpected motion reply (%s, %s), moves are followed with the status frame.", position, motion);
+            motionQuerySupported = false;
+        }
+        return false;
+    }
 
-            if (Power1SP.s != IPS_OK || Power2SP.s != IPS_OK || Power3SP.s != IPS_OK)
-            {
-                Power1S[0].s = (std::stod(result[Q_OUT1]) > 0) ? ISS_ON : ISS_OFF;
-                Power1S[1].s = (std::stod(result[Q_OUT1]) == 0) ? ISS_ON : ISS_OFF;
-                Power1SP.s = IPS_OK;
-                IDSetSwitch(&Power1SP, nullptr);
-                Power2S[0].s = (std::stod(result[Q_OUT2]) > 0) ? ISS_ON : ISS_OFF;
-                Power2S[1].s = (std::stod(result[Q_OUT2]) == 0) ? ISS_ON : ISS_OFF;
-                Power2SP.s = IPS_OK;
-                IDSetSwitch(&Power2SP, nullptr);
-                Power3S[0].s = (std::stod(result[Q_OUT3]) > 0) ? ISS_ON : ISS_OFF;
-                Power3S[1].s = (std::stod(result[Q_OUT3]) == 0) ? ISS_ON : ISS_OFF;
-                Power3SP.s = IPS_OK;
-                IDSetSwitch(&Power3SP, nullptr);
-            }
+    // the distance left is only in the full frame, its last value holds while the focuser moves
+    const DeviceState &last = deviceState();
+    if (busy > 0 && last.stepsToGo[index] == 0)
+        return false;
 
-            PWMN[0].value = std::stod(result[Q_PWM1]);
-            PWMN[1].value = std::stod(result[Q_PWM2]);
-            PWMNP.s = IPS_OK;
-            IDSetNumber(&PWMNP, nullptr);
+    // the rest of the state is carried over from the last full frame
+    DeviceState &next = deviceStates[1 - activeState];
+    next = last;
+    next.position[index] = value;
+    if (busy <= 0)
+        next.stepsToGo[index] = 0;
+    next.timestamp = requestTime + latency / 2.0;
+    next.wallTime = requestWallTime + latency / 2.0;
+    next.sequence = last.sequence + 1;
+    activeState = 1 - activeState;
+    stateStale = false;
+    pollLatency.add(next.timestamp, latency * 1000.0);
+    motionQueries++;
+    return true;
+}
 
-            PowerDataN[POW_ITOT].value = std::stod(result[Q_ITOT]);
-            PowerDataN[POW_REG].value = std::stod(result[Q_VREG]);
-            PowerDataN[POW_VIN].value = std::stod(result[Q_VIN]);
-            PowerDataN[POW_AH].value = std::stod(result[Q_AH]);
-            PowerDataN[POW_WH].value = std::stod(result[Q_WH]);
-            PowerDataNP.s = IPS_OK;
-            IDSetNumber(&PowerDataNP, nullptr);
+bool IndiAstroLink4mini2::commitStatus(const char *res, double timestamp, double wallTime)
+{
+    DeviceState &next = deviceStates[1 - activeState];
+    if (!decodeStatus(res, next))
+    {
+        LOGF_WARN("Invalid status frame: %s", res);
+        frameErrors++;
+        return false;
+    }
+    next.timestamp = timestamp;
+    next.wallTime = wallTime;
+    next.sequence = deviceState().sequence + 1;
+    activeState = 1 - activeState;
+    stateStale = false;
+    return true;
+}
+
+bool IndiAstroLink4mini2::decodeStatus(const char *res, DeviceState &state)
+{
+    char frame[ASTROLINK4_LEN];
+    const char *fields[Q_SBM + 2];
+    snprintf(frame, sizeof(frame), "%s", res);
+    // fields are numbered from the device code that follows the 'q' tag
+    int count = tokenizeFrame(frame, fields, Q_SBM + 2) - 1;
+    const char *const *result = fields + 1;
+    if (count <= Q_FOC2_TO_GO)
+        return false;
+
+    double value[Q_SBM + 1];
+    int decoded = std::min(count, Q_SBM + 1);
+    for (int i = Q_FOC1_POS; i < decoded; i++)
+    {
+        // the overload value is kept verbatim, the rest is numeric
+        if (i != Q_OVERVALUE && !parseField(result[i], value[i]))
+            return false;
+    }
+
+    state.position[0] = value[Q_FOC1_POS];
+    state.position[1] = value[Q_FOC2_POS];
+    state.stepsToGo[0] = value[Q_FOC1_TO_GO];
+    state.stepsToGo[1] = value[Q_FOC2_TO_GO];
+    state.extended = count > Q_SBM;
+    if (!state.extended)
+        return true;
+
+    state.current = value[Q_ITOT];
+    state.sensors = (value[Q_SENS1_PRESENT] > 0 ? SENSOR_SENS1 : 0) | (value[Q_SENS2_PRESENT] > 0 ? SENSOR_SENS2 : 0) |
+                    (value[Q_SENS2E_PRESENT] > 0 ? SENSOR_SENS2E : 0) | (value[Q_MLX_PRESENT] > 0 ? SENSOR_MLX : 0) |
+                    (value[Q_SBM_PRESENT] > 0 ? SENSOR_SBM : 0);
+    state.sens1Temp = value[Q_SENS1_TEMP];
+    state.sens1Hum = value[Q_SENS1_HUM];
+    state.sens1Dew = value[Q_SENS1_DEW];
+    state.sens2Temp = value[Q_SENS2_TEMP];
+    state.sens2eTemp = value[Q_SENS2E_TEMP];
+    state.sens2eHum = value[Q_SENS2E_HUM];
+    state.sens2eDew = value[Q_SENS2E_DEW];
+    state.pwm[0] = value[Q_PWM1];
+    state.pwm[1] = value[Q_PWM2];
+    state.output[0] = value[Q_OUT1] > 0;
+    state.output[1] = value[Q_OUT2] > 0;
+    state.output[2] = value[Q_OUT3] > 0;
+    state.vin = value[Q_VIN];
+    state.vreg = value[Q_VREG];
+    state.ah = value[Q_AH];
+    state.wh = value[Q_WH];
+    state.overType = value[Q_OVERTYPE];
+    snprintf(state.overValue, sizeof(state.overValue), "%s", result[Q_OVERVALUE]);
+    state.mlxTemp = value[Q_MLX_TEMP];
+    state.mlxAux = value[Q_MLX_AUX];
+    state.sbm = value[Q_SBM];
+    return true;
+}
+
+const IndiAstroLink4mini2::DeviceState &IndiAstroLink4mini2::freshState()
+{
+    if (stateStale || monotonicNow() - deviceState().timestamp > STATE_MAX_AGE)
+        queryStatus();
+    return deviceState();
+}
+
+int IndiAstroLink4mini2::focuserTarget()
+{
+    // while moving, new relative moves continue from where the running move ends
+    const DeviceState &state = freshState();
+    int index = getFindex();
+    if (backlashPending)
+        return backlashTarget;
+    return (state.stepsToGo[index] != 0) ? moveTarget[index] : state.position[index];
+}
+
+template <int F>
+void IndiAstroLink4mini2::publishFocuserSettings(const char *const fields[], int count)
+{
+    INumberVectorProperty &settingsNP = (F == 0) ? Focuser1SettingsNP : Focuser2SettingsNP;
+    if (settingsNP.s != IPS_OK)
+    {
+        double values[FS_COUNT];
+        if (FocuserFields<F>::decode(fields, count, values))
+        {
+            DEBUGF(INDI::Logger::DBG_DEBUG, "Update settings, focuser %i", F + 1);
+            for (int i = 0; i < FS_COUNT; i++)
+                settingsNP.np[i].value = values[i];
+            settingsNP.s = IPS_OK;
+        }
+        else
+        {
+            settingsNP.s = IPS_ALERT;
         }
+        queueSet(&settingsNP);
     }
 
-    // update settings data if was changed
-    if (PowerDefaultOnSP.s != IPS_OK || FocusMaxPosNP.getState() != IPS_OK || FocusReverseSP.getState() != IPS_OK || FocuserSelectSP.s != IPS_OK || Focuser1SettingsNP.s != IPS_OK || Focuser2SettingsNP.s != IPS_OK || Focuser1ModeSP.s != IPS_OK || Focuser2ModeSP.s != IPS_OK)
+    ISwitchVectorProperty &modeSP = (F == 0) ? Focuser1ModeSP : Focuser2ModeSP;
+    double mode;
+    if (modeSP.s != IPS_OK && parseField(fields[FocuserFields<F>::index(FOCUSER_MODE_FIELD)], mode))
     {
-        if (sendCommand("u", res))
+        for (int i = 0; i < modeSP.nsp; i++)
+            modeSP.sp[i].s = (i == static_cast<int>(mode)) ? ISS_ON : ISS_OFF;
+        modeSP.s = IPS_OK;
+        queueSet(&modeSP);
+    }
+}
+
+void IndiAstroLink4mini2::publishFocuser(const DeviceState &state)
+{
+    double now = state.timestamp;
+    int focuserPosition = state.position[getFindex()];
+    int stepsToGo = state.stepsToGo[getFindex()];
+    if (motionProfiler.sample(now, focuserPosition, stepsToGo))
+        updateMotionProfile();
+    FocusAbsPosNP[0].setValue(focuserPosition);
+    bool moveFailed = false;
+    if (stepsToGo == 0 && backlashPending && exposureActive())
+    {
+        // the return leg would shift focus during the exposure
+        if (!backlashHeld)
         {
-            std::vector<std::string> result = split(res, ":");
+            backlashHeld = true;
+            guardHeld++;
+            publishCameraGuard();
+        }
+    }
+    else if (stepsToGo == 0 && backlashPending)
+    {
+        // first leg of a backlash move done, return to the requested target right away
+        backlashPending = false;
+        backlashHeld = false;
+        if (startMove(backlashTarget))
+            stepsToGo = std::abs(static_cast<int>(backlashTarget) - focuserPosition);
+        else
+            moveFailed = true;
+    }
+    if (moveFailed)
+    {
+        LOG_ERROR("Backlash compensation return move failed.");
+        FocusAbsPosNP.setState(IPS_ALERT);
+        FocusRelPosNP.setState(IPS_ALERT);
+    }
+    else if (stepsToGo == 0 && !backlashPending)
+    {
+        moving = false;
+        FocusAbsPosNP.setState(IPS_OK);
+        FocusRelPosNP.setState(IPS_OK);
+    }
+    else
+    {
+        FocusAbsPosNP.setState(IPS_BUSY);
+        FocusRelPosNP.setState(IPS_BUSY);
+    }
+    queueSet(FocusRelPosNP);
+    queueSet(FocusAbsPosNP);
+    if (focusSweep.active)
+        runFocusSweep(state);
+}
 
-            if (PowerDefaultOnSP.s != IPS_OK)
-            {
-                PowerDefaultOnS[0].s = (std::stod(result[U_OUT1_DEF]) > 0) ? ISS_ON : ISS_OFF;
-                PowerDefaultOnS[1].s = (std::stod(result[U_OUT2_DEF]) > 0) ? ISS_ON : ISS_OFF;
-                PowerDefaultOnS[2].s = (std::stod(result[U_OUT3_DEF]) > 0) ? ISS_ON : ISS_OFF;
-                PowerDefaultOnSP.s = IPS_OK;
-                IDSetSwitch(&PowerDefaultOnSP, nullptr);
-            }
+bool IndiAstroLink4mini2::readDevice()
+{
+    char res[ASTROLINK4_LEN] = {0};
+    if (deferredSettings.size() > 0 && !exposureActive())
+        flushDeferredSettings();
 
-            if (Focuser1SettingsNP.s != IPS_OK)
-            {
+    // between full frames a move is followed with the short queries only,
+    // the full frame is read in their place when they give no answer
+    if (motionTracking() && monotonicNow() - lastFullStatus < POLLTIME / 1000.0 && queryMotion())
+    {
+        publishFocuser(deviceState());
+        return true;
+    }
 
-                DEBUGF(INDI::Logger::DBG_DEBUG, "Update settings, focuser 1, res %s", res);
-                Focuser1SettingsN[FS1_STEP_SIZE].value = std::stod(result[U_FOC1_STEP]) / 100.0;
-                Focuser1SettingsN[FS1_COMPENSATION].value = std::stod(result[U_FOC1_COMPSTEPS]) / 100.0;
-                Focuser1SettingsN[FS1_COMP_THRESHOLD].value = std::stod(result[U_FOC1_COMPTRIGGER]);
-                Focuser1SettingsN[FS1_SPEED].value = std::stod(result[U_FOC1_SPEED]);
-                Focuser1SettingsN[FS1_CURRENT].value = std::stod(result[U_FOC1_CUR]) * 10.0;
-                Focuser1SettingsN[FS1_HOLD].value = std::stod(result[U_FOC1_HOLD]);
-                Focuser1SettingsNP.s = IPS_OK;
-                IDSetNumber(&Focuser1SettingsNP, nullptr);
-            }
+    if (queryStatus())
+    {
+        const DeviceState &state = deviceState();
+        double now = state.timestamp;
+        publishFocuser(state);
 
-            if (Focuser2SettingsNP.s != IPS_OK)
-            {
-                DEBUGF(INDI::Logger::DBG_DEBUG, "Update settings, focuser 2, res %s", res);
-                Focuser2SettingsN[FS2_STEP_SIZE].value = std::stod(result[U_FOC2_STEP]) / 100.0;
-                Focuser2SettingsN[FS2_COMPENSATION].value = std::stod(result[U_FOC2_COMPSTEPS]) / 100.0;
-                Focuser2SettingsN[FS2_COMP_THRESHOLD].value = std::stod(result[U_FOC2_COMPTRIGGER]);
-                Focuser2SettingsN[FS2_SPEED].value = std::stod(result[U_FOC2_SPEED]);
-                Focuser2SettingsN[FS2_CURRENT].value = std::stod(result[U_FOC2_CUR]) * 10.0;
-                Focuser2SettingsN[FS2_HOLD].value = std::stod(result[U_FOC2_HOLD]);
-                Focuser2SettingsNP.s = IPS_OK;
-                IDSetNumber(&Focuser2SettingsNP, nullptr);
-            }
+        if (state.extended)
+        {
+            if (!sensorsKnown || state.sensors != sensors)
+                discoverSensors(state.sensors);
+            for (SensorPublisher publish : sensorPublishers)
+                (this->*publish)(state, now);
+            // the parameters and the verdicts are left to the weather interface timer
+            WeatherStatsNP.s = IPS_OK;
+            queueSet(&WeatherStatsNP);
+
+            publishOutputs(state, Power1SP.s != IPS_OK || Power2SP.s != IPS_OK || Power3SP.s != IPS_OK);
+
+            PowerDataN[POW_ITOT].value = state.current;
+            PowerDataN[POW_REG].value = state.vreg;
+            PowerDataN[POW_VIN].value = state.vin;
+            PowerDataN[POW_AH].value = state.ah;
+            PowerDataN[POW_WH].value = state.wh;
+            PowerDataNP.s = IPS_OK;
+            queueSet(&PowerDataNP);
+
+            updateProtection(state.overType, state.overValue);
+        }
+    }
+
+    // while a fault is being tracked at the fast cadence only the power data is refreshed
+    if (protectionType > 0 && ProtectionPollS[PROT_POLL_FAST].s == ISS_ON)
+        return true;
 
-            if (Focuser1ModeSP.s != IPS_OK)
+    // update settings data if was changed, not while a camera is exposing
+    if (exposureActive())
+        return true;
+    if (FocusMaxPosNP.getState() != IPS_OK || FocusReverseSP.getState() != IPS_OK || refreshPending(REFRESH_SETTINGS))
+    {
+        const char *fields[U_FIELD_COUNT];
+        int count = 0;
+        if (sendCommand("u", res))
+        {
+            count = tokenizeFrame(res, fields, U_FIELD_COUNT);
+        }
+        if (count > U_OVERTIME)
+        {
+            double value = 0;
+            if (PowerDefaultOnSP.s != IPS_OK)
             {
-                Focuser1ModeS[FS1_MODE_UNI].s = Focuser1ModeS[FS1_MODE_MICRO_L].s = Focuser1ModeS[FS1_MODE_MICRO_H].s = ISS_OFF;
-                if (!strcmp("0", result[U_FOC1_MODE].c_str()))
-                    Focuser1ModeS[FS1_MODE_UNI].s = ISS_ON;
-                if (!strcmp("1", result[U_FOC1_MODE].c_str()))
-                    Focuser1ModeS[FS1_MODE_MICRO_L].s = ISS_ON;
-                if (!strcmp("2", result[U_FOC1_MODE].c_str()))
-                    Focuser1ModeS[FS1_MODE_MICRO_H].s = ISS_ON;
-                Focuser1ModeSP.s = IPS_OK;
-                IDSetSwitch(&Focuser1ModeSP, nullptr);
+                PowerDefaultOnS[0].s = (parseField(fields[U_OUT1_DEF], value) && value > 0) ? ISS_ON : ISS_OFF;
+                PowerDefaultOnS[1].s = (parseField(fields[U_OUT2_DEF], value) && value > 0) ? ISS_ON : ISS_OFF;
+                PowerDefaultOnS[2].s = (parseField(fields[U_OUT3_DEF], value) && value > 0) ? ISS_ON : ISS_OFF;
+                PowerDefaultOnSP.s = IPS_OK;
+                queueSet(&PowerDefaultOnSP);
             }
 
-            if (Focuser2ModeSP.s != IPS_OK)
+            if (ProtectionSettingsNP.s != IPS_OK)
             {
-                Focuser2ModeS[FS2_MODE_UNI].s = Focuser2ModeS[FS2_MODE_MICRO_L].s = Focuser2ModeS[FS2_MODE_MICRO_H].s = ISS_OFF;
-                if (!strcmp("0", result[U_FOC2_MODE].c_str()))
-                    Focuser2ModeS[FS2_MODE_UNI].s = ISS_ON;
-                if (!strcmp("1", result[U_FOC2_MODE].c_str()))
-                    Focuser2ModeS[FS2_MODE_MICRO_L].s = ISS_ON;
-                if (!strcmp("2", result[U_FOC2_MODE].c_str()))
-                    Focuser2ModeS[FS2_MODE_MICRO_H].s = ISS_ON;
-                Focuser2ModeSP.s = IPS_OK;
-                IDSetSwitch(&Focuser2ModeSP, nullptr);
+                for (const auto &field : PROTECTION_FIELDS)
+                {
+                    if (parseField(fields[field.index[0]], value))
+                        ProtectionSettingsN[field.element].value = value / field.scale;
+                }
+                ProtectionSettingsNP.s = IPS_OK;
+                queueSet(&ProtectionSettingsNP);
             }
 
-            if (FocusMaxPosNP.getState() != IPS_OK)
+            publishFocuserSettings<0>(fields, count);
+            publishFocuserSettings<1>(fields, count);
+
+            if (FocusMaxPosNP.getState() != IPS_OK && parseField(fields[FOCUSER_MAX_FIELD.index[getFindex()]], value))
             {
-                DEBUGF(INDI::Logger::DBG_DEBUG, "Update maxpos, focuser %i, res %s", getFindex(), res);
-                int index = getFindex() > 0 ? U_FOC2_MAX : U_FOC1_MAX;
-                FocusMaxPosNP[0].setValue(std::stod(result[index]));
+                DEBUGF(INDI::Logger::DBG_DEBUG, "Update maxpos, focuser %i, value %.0f", getFindex(), value);
+                FocusMaxPosNP[0].setValue(value / FOCUSER_MAX_FIELD.scale);
                 FocusMaxPosNP.setState(IPS_OK);
-                FocusMaxPosNP.apply();
+                queueSet(FocusMaxPosNP);
             }
-            if (FocusReverseSP.getState() != IPS_OK)
+            if (FocusReverseSP.getState() != IPS_OK && parseField(fields[FOCUSER_REVERSE_FIELD.index[getFindex()]], value))
             {
-                DEBUGF(INDI::Logger::DBG_DEBUG, "Update reverse, focuser %i, res %s", getFindex(), res);
-                int index = getFindex() > 0 ? U_FOC2_REV : U_FOC1_REV;
-                FocusReverseSP[0].setState((std::stoi(result[index]) > 0) ? ISS_ON : ISS_OFF);
-                FocusReverseSP[1].setState((std::stoi(result[index]) == 0) ? ISS_ON : ISS_OFF);
+                DEBUGF(INDI::Logger::DBG_DEBUG, "Update reverse, focuser %i, value %.0f", getFindex(), value);
+                FocusReverseSP[0].setState((value > 0) ? ISS_ON : ISS_OFF);
+                FocusReverseSP[1].setState((value == 0) ? ISS_ON : ISS_OFF);
                 FocusReverseSP.setState(IPS_OK);
-                FocusReverseSP.apply();
+                queueSet(FocusReverseSP);
             }
             FocuserSelectSP.s = IPS_OK;
-            IDSetSwitch(&FocuserSelectSP, nullptr);
+            queueSet(&FocuserSelectSP);
         }
     }
 
     return true;
 }
 
+void IndiAstroLink4mini2::updateMotionProfile()
+{
+    FocuserMotionProfiler::Summary summary = motionProfiler.summary();
+    MotionProfileN[MP_MOVES].value = summary.moves;
+    MotionProfileN[MP_AVG_PPS].value = summary.averagePps;
+    MotionProfileN[MP_PEAK_PPS].value = summary.peakPps;
+    MotionProfileN[MP_AVG_DURATION].value = summary.averageDuration;
+    MotionProfileN[MP_MAX_OVERSHOOT].value = summary.maxOvershoot;
+    if (motionProfiler.hasMoves())
+    {
+        const FocuserMotionProfiler::Move &move = motionProfiler.lastMove();
+        double speed = (move.focuser > 0) ? Focuser2SettingsN[FS2_SPEED].value : Focuser1SettingsN[FS1_SPEED].value;
+        MotionProfileN[MP_LAST_PPS].value = move.averagePps;
+        MotionProfileN[MP_LAST_DURATION].value = move.duration;
+        // time lost to acceleration, settling and polling against an ideal move at the configured speed
+        MotionProfileN[MP_LAST_OVERHEAD].value = move.duration - std::abs(move.target - move.startPosition) / speed;
+        DEBUGF(INDI::Logger::DBG_DEBUG, "Move %d -> %d: %.2f s, %.1f pps average, %.1f pps peak, overshoot %d",
+               move.startPosition, move.target, move.duration, move.averagePps, move.peakPps, move.overshoot);
+    }
+    else
+    {
+        MotionProfileN[MP_LAST_PPS].value = MotionProfileN[MP_LAST_DURATION].value = MotionProfileN[MP_LAST_OVERHEAD].value = 0;
+    }
+    MotionProfileNP.s = IPS_OK;
+    queueSet(&MotionProfileNP);
+}
+
 //////////////////////////////////////////////////////////////////////
-/// Helper functions
+/// Protection
+//////////////////////////////////////////////////////////////////////
+void IndiAstroLink4mini2::updateProtection(int type, const std::string &value)
+{
+    if (type == protectionType)
+        return;
+
+    if (type != 0)
+    {
+        const char *typeName = (type == OVERTYPE_VOLTAGE) ? "Over-voltage" : (type == OVERTYPE_CURRENT) ? "Over-current" : "Over-load";
+        char timestamp[32];
+        time_t now = time(nullptr);
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", gmtime(&now));
+        IUSaveText(&ProtectionEventT[PROT_EVENT_TYPE], typeName);
+        IUSaveText(&ProtectionEventT[PROT_EVENT_VALUE], value.c_str());
+        IUSaveText(&ProtectionEventT[PROT_EVENT_TIME], timestamp);
+        ProtectionEventTP.s = IPS_ALERT;
+        queueSet(&ProtectionEventTP);
+        LOGF_WARN("%s protection triggered, value %s", typeName, value.c_str());
+        // the firmware may have switched outputs off, read them back on the next poll
+        Power1SP.s = Power2SP.s = Power3SP.s = IPS_BUSY;
+    }
+    else
+    {
+        ProtectionEventTP.s = IPS_OK;
+        queueSet(&ProtectionEventTP);
+        if (protectionType > 0)
+            LOG_INFO("Protection fault cleared.");
+    }
+
+    ProtectionL[PROT_VOLTAGE].s = (type == OVERTYPE_VOLTAGE) ? IPS_ALERT : IPS_OK;
+    ProtectionL[PROT_CURRENT].s = (type != 0 && type != OVERTYPE_VOLTAGE) ? IPS_ALERT : IPS_OK;
+    ProtectionLP.s = (type != 0) ? IPS_ALERT : IPS_OK;
+    queueSet(&ProtectionLP);
+    protectionType = type;
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Weather
 //////////////////////////////////////////////////////////////////////
-std::vector<std::string> IndiAstroLink4mini2::split(const std::string &input, const std::string &regex)
+void IndiAstroLink4mini2::addWeatherSample(int parameter, double timestamp, double value)
+{
+    SlidingWindowStats &stats = weatherStats[parameter];
+    stats.add(timestamp, value);
+    INumber *np = &WeatherStatsN[parameter * STAT_COUNT];
+    np[STAT_MIN].value = stats.min();
+    np[STAT_MAX].value = stats.max();
+    np[STAT_MEAN].value = stats.mean();
+    np[STAT_STDDEV].value = stats.stddev();
+    np[STAT_RATE].value = stats.rate();
+}
+
+void IndiAstroLink4mini2::discoverSensors(unsigned found)
+{
+    // on the first discovery every absent sensor is reset once, later only the ones that went away
+    bool rediscovery = sensorsKnown;
+    unsigned removed = rediscovery ? (sensors & ~found) : ~found;
+    unsigned added = rediscovery ? (found & ~sensors) : found;
+    sensors = found;
+    sensorsKnown = true;
+
+    std::string names;
+    const char *labels[5] = {"ambient", "probe", "ambient 2", "sky", "SQM"};
+    for (int i = 0; i < 5; i++)
+    {
+        if (found & (1u << i))
+            names += names.empty() ? labels[i] : std::string(", ") + labels[i];
+    }
+    LOGF_INFO("Sensors: %s", names.empty() ? "none" : names.c_str());
+    IUSaveText(&FirmwareT[FW_SENSORS], names.c_str());
+
+    if (removed & SENSOR_SENS1)
+    {
+        setParameterValue("WEATHER_TEMPERATURE", 0.0);
+        setParameterValue("WEATHER_HUMIDITY", 0.0);
+        setParameterValue("WEATHER_DEWPOINT", 0.0);
+        weatherStats[WSTAT_TEMPERATURE].clear();
+        weatherStats[WSTAT_HUMIDITY].clear();
+        weatherStats[WSTAT_DEW_MARGIN].clear();
+        dewFlag.reset();
+    }
+    if (removed & SENSOR_MLX)
+    {
+        setParameterValue("WEATHER_SKY_TEMP", 0.0);
+        setParameterValue("WEATHER_SKY_DIFF", 0.0);
+        weatherStats[WSTAT_SKY_DIFF].clear();
+        cloudFlag.reset();
+    }
+    if (removed & SENSOR_SBM)
+        setParameterValue("SQM_READING", 0.0);
+
+    // properties of a sensor exist only while it is attached
+    if (isConnected())
+    {
+        for (const auto &entry : properties)
+        {
+            if (entry.sensor & added)
+                defineEntry(entry);
+            else if (rediscovery && (entry.sensor & removed))
+                deleteProperty(entry.name());
+        }
+        queueSet(&FirmwareTP);
+    }
+
+    sensorPublishers.clear();
+    if (found & SENSOR_SENS1)
+        sensorPublishers.push_back(&IndiAstroLink4mini2::publishSens1);
+    if (found & SENSOR_SENS2)
+        sensorPublishers.push_back(&IndiAstroLink4mini2::publishSens2);
+    if (found & SENSOR_SENS2E)
+        sensorPublishers.push_back(&IndiAstroLink4mini2::publishSens2E);
+    if (found & SENSOR_MLX)
+        sensorPublishers.push_back(&IndiAstroLink4mini2::publishSky);
+    if (found & SENSOR_SBM)
+        sensorPublishers.push_back(&IndiAstroLink4mini2::publishSBM);
+}
+
+void IndiAstroLink4mini2::publishSens1(const DeviceState &state, double now)
+{
+    setParameterValue("WEATHER_TEMPERATURE", state.sens1Temp);
+    setParameterValue("WEATHER_HUMIDITY", state.sens1Hum);
+    setParameterValue("WEATHER_DEWPOINT", state.sens1Dew);
+    addWeatherSample(WSTAT_TEMPERATURE, now, state.sens1Temp);
+    addWeatherSample(WSTAT_HUMIDITY, now, state.sens1Hum);
+    addWeatherSample(WSTAT_DEW_MARGIN, now, state.sens1Temp - state.sens1Dew);
+}
+
+void IndiAstroLink4mini2::publishSens2(const DeviceState &state, double)
+{
+    Sensor2N[0].value = state.sens2Temp;
+    Sensor2NP.s = IPS_OK;
+    queueSet(&Sensor2NP);
+}
+
+void IndiAstroLink4mini2::publishSens2E(const DeviceState &state, double)
 {
-    // passing -1 as the submatch index parameter performs splitting
-    std::regex re(regex);
-    std::sregex_token_iterator
-        first{input.begin(), input.end(), re, -1},
-        last;
-    return {first, last};
+    Sensor2EN[SENS2E_TEMP].value = state.sens2eTemp;
+    Sensor2EN[SENS2E_HUM].value = state.sens2eHum;
+    Sensor2EN[SENS2E_DEW].value = state.sens2eDew;
+    Sensor2ENP.s = IPS_OK;
+    queueSet(&Sensor2ENP);
 }
 
-std::string IndiAstroLink4mini2::doubleToStr(double val)
+void IndiAstroLink4mini2::publishSky(const DeviceState &state, double now)
 {
-    char buf[10];
-    sprintf(buf, "%.0f", val);
-    return std::string(buf);
+    setParameterValue("WEATHER_SKY_TEMP", state.mlxTemp);
+    setParameterValue("WEATHER_SKY_DIFF", state.mlxTemp - state.mlxAux);
+    addWeatherSample(WSTAT_SKY_DIFF, now, state.mlxTemp - state.mlxAux);
 }
 
-std::string IndiAstroLink4mini2::intToStr(double val)
+void IndiAstroLink4mini2::publishSBM(const DeviceState &state, double)
 {
-    char buf[10];
-    sprintf(buf, "%i", (int)val);
-    return std::string(buf);
+    setParameterValue("SQM_READING", state.sbm + SQMOffsetN[0].value);
 }
 
-bool IndiAstroLink4mini2::updateSettings(const char *getCom, const char *setCom, int index, const char *value)
+IPState IndiAstroLink4mini2::updateWeather()
 {
-    std::map<int, std::string> values;
-    values[index] = value;
-    return updateSettings(getCom, setCom, values);
+    // decisions are made on window means, single noisy readings do not flip the state
+    if (hasSensor(SENSOR_MLX) && weatherStats[WSTAT_SKY_DIFF].count() > 0)
+        SafetyStatusL[SAFETY_CLOUD].s = cloudFlag.update(weatherStats[WSTAT_SKY_DIFF].mean()) ? IPS_ALERT : IPS_OK;
+    else
+        SafetyStatusL[SAFETY_CLOUD].s = IPS_IDLE;
+
+    if (hasSensor(SENSOR_SENS1) && weatherStats[WSTAT_DEW_MARGIN].count() > 0)
+        SafetyStatusL[SAFETY_DEW].s = dewFlag.update(weatherStats[WSTAT_DEW_MARGIN].mean()) ? IPS_ALERT : IPS_OK;
+    else
+        SafetyStatusL[SAFETY_DEW].s = IPS_IDLE;
+
+    // the critical parameters carry the verdicts into WEATHER_STATUS
+    setParameterValue("WEATHER_CLOUD_RISK", SafetyStatusL[SAFETY_CLOUD].s == IPS_ALERT ? 1 : 0);
+    setParameterValue("WEATHER_DEW_RISK", SafetyStatusL[SAFETY_DEW].s == IPS_ALERT ? 1 : 0);
+    // published once per weather update, together with the status evaluated from it
+    queueSet(ParametersNP);
+
+    IPState state = IPS_IDLE;
+    for (const auto &light : SafetyStatusL)
+        state = std::max(state, light.s);
+    SafetyStatusLP.s = state;
+    queueSet(&SafetyStatusLP);
+
+    return IPS_OK;
 }
 
-bool IndiAstroLink4mini2::updateSettings(const char *getCom, const char *setCom, std::map<int, std::string> values)
+//////////////////////////////////////////////////////////////////////
+/// Helper functions
+//////////////////////////////////////////////////////////////////////
+IPState IndiAstroLink4mini2::updateSettings(const SettingsUpdate &update)
 {
     // Do not update till init is not complete
     if (!initComplete)
-        return false;
+        return IPS_ALERT;
+
+    // written in one go once the camera guard lets go
+    if (exposureActive())
+    {
+        deferredSettings.merge(update);
+        guardDeferred++;
+        publishCameraGuard();
+        LOG_INFO("Settings change deferred until the exposure ends.");
+        return IPS_BUSY;
+    }
+    return writeSettings(update) ? IPS_OK : IPS_ALERT;
+}
 
+bool IndiAstroLink4mini2::writeSettings(const SettingsUpdate &update)
+{
+    // read-modify-write: the 'U' frame is the current 'u' reply with the updated fields
     char cmd[ASTROLINK4_LEN] = {0}, res[ASTROLINK4_LEN] = {0};
-    snprintf(cmd, ASTROLINK4_LEN, "%s", getCom);
-    if (sendCommand(cmd, res))
+    if (!sendCommand("u", res))
+        return false;
+    if (!update.build(res, cmd, ASTROLINK4_LEN))
+        return false;
+    return sendCommand(cmd, res);
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Property registry
+//////////////////////////////////////////////////////////////////////
+const char *IndiAstroLink4mini2::PropertyEntry::name() const
+{
+    return number ? number->name : switches ? switches->name : text ? text->name : lights->name;
+}
+
+const char *IndiAstroLink4mini2::PropertyEntry::tab() const
+{
+    return number ? number->group : switches ? switches->group : text ? text->group : lights->group;
+}
+
+IPState IndiAstroLink4mini2::PropertyEntry::state() const
+{
+    return number ? number->s : switches ? switches->s : text ? text->s : lights->s;
+}
+
+void IndiAstroLink4mini2::registerProperty(INumberVectorProperty *nvp, NumberHandler handler, bool persist, RefreshGroup refresh, unsigned sensor)
+{
+    properties.push_back({nvp, nullptr, nullptr, nullptr, handler, nullptr, nullptr, persist, refresh, sensor});
+    propertyIndex[nvp->name] = properties.size() - 1;
+}
+
+void IndiAstroLink4mini2::registerProperty(ISwitchVectorProperty *svp, SwitchHandler handler, bool persist, RefreshGroup refresh)
+{
+    properties.push_back({nullptr, svp, nullptr, nullptr, nullptr, handler, nullptr, persist, refresh, 0});
+    propertyIndex[svp->name] = properties.size() - 1;
+}
+
+void IndiAstroLink4mini2::registerProperty(ILightVectorProperty *lvp, RefreshGroup refresh)
+{
+    properties.push_back({nullptr, nullptr, lvp, nullptr, nullptr, nullptr, nullptr, false, refresh, 0});
+    propertyIndex[lvp->name] = properties.size() - 1;
+}
+
+void IndiAstroLink4mini2::registerProperty(ITextVectorProperty *tvp, TextHandler handler, bool persist, RefreshGroup refresh)
+{
+    properties.push_back({nullptr, nullptr, nullptr, tvp, nullptr, nullptr, handler, persist, refresh, 0});
+    propertyIndex[tvp->name] = properties.size() - 1;
+}
+
+void IndiAstroLink4mini2::queueSet(INumberVectorProperty *nvp)
+{
+    if (batchingSets)
+        queuePending({nvp, nullptr, nullptr, nullptr, nullptr});
+    else
+        IDSetNumber(nvp, nullptr);
+}
+
+void IndiAstroLink4mini2::queueSet(ISwitchVectorProperty *svp)
+{
+    if (batchingSets)
+        queuePending({nullptr, svp, nullptr, nullptr, nullptr});
+    else
+        IDSetSwitch(svp, nullptr);
+}
+
+void IndiAstroLink4mini2::queueSet(ITextVectorProperty *tvp)
+{
+    if (batchingSets)
+        queuePending({nullptr, nullptr, tvp, nullptr, nullptr});
+    else
+        IDSetText(tvp, nullptr);
+}
+
+void IndiAstroLink4mini2::queueSet(ILightVectorProperty *lvp)
+{
+    if (batchingSets)
+        queuePending({nullptr, nullptr, nullptr, lvp, nullptr});
+    else
+        IDSetLight(lvp, nullptr);
+}
+
+void IndiAstroLink4mini2::queueSet(INDI::Property &property)
+{
+    if (batchingSets)
+        queuePending({nullptr, nullptr, nullptr, nullptr, &property});
+    else
+        property.apply();
+}
+
+void IndiAstroLink4mini2::queuePending(const PendingSet &set)
+{
+    // a tick touches a few dozen properties at most, a linear scan is enough
+    for (const auto &pending : pendingSets)
     {
-        std::string concatSettings = "";
-        std::vector<std::string> result = split(res, ":");
-        if (result.size() >= values.size())
-        {
-            result[0] = setCom;
-            for (std::map<int, std::string>::iterator it = values.begin(); it != values.end(); ++it)
-                result[it->first] = it->second;
+        if (pending.number == set.number && pending.switches == set.switches && pending.text == set.text &&
+                pending.lights == set.lights && pending.property == set.property)
+            return;
+    }
+    pendingSets.push_back(set);
+}
+
+void IndiAstroLink4mini2::flushProperties()
+{
+    batchingSets = false;
+    for (const auto &pending : pendingSets)
+    {
+        if (pending.number)
+            IDSetNumber(pending.number, nullptr);
+        else if (pending.switches)
+            IDSetSwitch(pending.switches, nullptr);
+        else if (pending.text)
+            IDSetText(pending.text, nullptr);
+        else if (pending.lights)
+            IDSetLight(pending.lights, nullptr);
+        else
+            pending.property->apply();
+    }
+    pendingSets.clear();
+}
+
+void IndiAstroLink4mini2::defineEntry(const PropertyEntry &entry)
+{
+    if (entry.number)
+        defineProperty(entry.number);
+    else if (entry.switches)
+        defineProperty(entry.switches);
+    else if (entry.text)
+        defineProperty(entry.text);
+    else
+        defineProperty(entry.lights);
+}
 
-            for (const auto &piece : result)
-                concatSettings += piece + ":";
+const IndiAstroLink4mini2::PropertyEntry *IndiAstroLink4mini2::findProperty(const char *name) const
+{
+    auto it = propertyIndex.find(name);
+    return (it != propertyIndex.end()) ? &properties[it->second] : nullptr;
+}
 
-            snprintf(cmd, ASTROLINK4_LEN, "%s", concatSettings.c_str());
-            if (sendCommand(cmd, res))
-                return true;
-        }
+bool IndiAstroLink4mini2::refreshPending(RefreshGroup refresh) const
+{
+    for (const auto &entry : properties)
+    {
+        if (entry.refresh == refresh && entry.state() != IPS_OK)
+            return true;
     }
     return false;
 }
@@ -26,95 +26,30 @@
 #include <fcntl.h>
 #include <termios.h>
 #include <memory>
-#include <regex>
 #include <cstring>
-#include <map>
 #include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include <defaultdevice.h>
 #include <indifocuserinterface.h>
 #include <indiweatherinterface.h>
 #include <connectionplugins/connectionserial.h>
+#include <connectionplugins/connectiontcp.h>
 
-#define Q_DEVICE_CODE 0
-#define Q_FOC1_POS 1
-#define Q_FOC1_TO_GO 2
-#define Q_FOC2_POS 3
-#define Q_FOC2_TO_GO 4
-#define Q_ITOT 5
-#define Q_SENS1_PRESENT 6
-#define Q_SENS1_TEMP 7
-#define Q_SENS1_HUM 8
-#define Q_SENS1_DEW 9
-#define Q_SENS2_PRESENT 10
-#define Q_SENS2_TEMP 11
-#define Q_PWM1 12
-#define Q_PWM2 13
-#define Q_OUT1 14
-#define Q_OUT2 15
-#define Q_OUT3 16
-#define Q_VIN 17
-#define Q_VREG 18
-#define Q_AH 19
-#define Q_WH 20
-#define Q_FOC1_COMP 21
-#define Q_FOC2_COMP 22
-#define Q_OVERTYPE 23
-#define Q_OVERVALUE 24
-#define Q_MLX_PRESENT 25
-#define Q_MLX_TEMP 26
-#define Q_MLX_AUX 27
-#define Q_SENS2E_PRESENT 28
-#define Q_SENS2E_TEMP 29
-#define Q_SENS2E_HUM 30
-#define Q_SENS2E_DEW 31
-#define Q_SBM_PRESENT 32
-#define Q_SBM 33
-
-#define U_BUZZER 1
-#define U_MANUAL 2
-#define U_FOC1_CUR 3
-#define U_FOC2_CUR 4
-#define U_FOC1_HOLD 5
-#define U_FOC2_HOLD 6
-#define U_FOC1_SPEED 7
-#define U_FOC2_SPEED 8
-#define U_FOC1_ACC 9
-#define U_FOC2_ACC 10
-#define U_FOC1_MODE 11
-#define U_FOC2_MODE 12
-#define U_FOC1_MAX 13
-#define U_FOC2_MAX 14
-#define U_FOC1_REV 15
-#define U_FOC2_REV 16
-#define U_FOC1_STEP 17
-#define U_FOC2_STEP 18
-#define U_FOC1_COMPSTEPS 19
-#define U_FOC2_COMPSTEPS 20
-#define U_FOC_COMP_CYCLE 21
-#define U_FOC1_COMPTRIGGER 22
-#define U_FOC2_COMPTRIGGER 23
-#define U_FOC1_COMPAUTO 24
-#define U_FOC2_COMPAUTO 25
-#define U_PWM_PRESC 26
-#define U_OUT1_DEF 27
-#define U_OUT2_DEF 28
-#define U_OUT3_DEF 29
-#define U_PWM1_DEF 30
-#define U_PWM2_DEF 31
-#define U_HUM_SENSOR 32
-#define U_HUM_START 33
-#define U_HUM_FULL 34
-#define U_TEMP_PRESET 35
-#define U_VREF 36
-#define U_OVERVOLTAGE 37
-#define U_OVERCURRENT 38
-#define U_OVERTIME 39
-#define U_COMPSENSOR 40
+#include "astrolink4_clock.h"
+#include "astrolink4_hotplug.h"
+#include "astrolink4_metrics.h"
+#include "astrolink4_profiler.h"
+#include "astrolink4_protocol.h"
+#include "astrolink4_transport.h"
+#include "astrolink4_weather.h"
 
 namespace Connection
 {
     class Serial;
+    class TCP;
 }
 
 class IndiAstroLink4mini2 : public INDI::DefaultDevice, public INDI::FocuserInterface, public INDI::WeatherInterface
@@ -128,6 +63,7 @@ public:
     virtual bool ISNewNumber(const char *dev, const char *name, double values[], char *names[], int n);
     virtual bool ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n);
     virtual bool ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n);
+    virtual bool ISSnoopDevice(XMLEle *root) override;
 
 protected:
     virtual const char *getDefaultName();
@@ -148,29 +84,334 @@ protected:
     virtual bool SetFocuserMaxPosition(uint32_t ticks) override;
 
     // Weather Overrides
-    virtual IPState updateWeather() override
-    {
-        return IPS_OK;
-    }
+    virtual IPState updateWeather() override;
 
 private:
+    // the soak harness ticks the poll loop itself, see astrolink4_soak_main.cpp
+    friend class SoakRun;
+
     virtual bool Handshake();
-    int PortFD = -1;
     Connection::Serial *serialConnection{nullptr};
+    Connection::TCP *tcpConnection{nullptr};
+    std::unique_ptr<AstroLinkTransport> transport;
     char stopChar{0xA}; // new line
     int focuserIndex;
     int getFindex();
     void setFindex(int index);
     bool initComplete = false;
     bool readDevice();
-    bool updateSettings(const char *getCom, const char *setCom, int index, const char *value);
-    bool updateSettings(const char *getCom, const char *setCom, std::map<int, std::string> values);
-    std::vector<std::string> split(const std::string &input, const std::string &regex);
-    std::string doubleToStr(double val);
-    std::string intToStr(double val);
+    // IPS_OK written, IPS_BUSY held back while a camera exposes, IPS_ALERT on failure
+    IPState updateSettings(const SettingsUpdate &update);
+    bool writeSettings(const SettingsUpdate &update);
+    template <int F> void publishFocuserSettings(const char *const fields[], int count);
+
+    // Property registry
+    typedef bool (IndiAstroLink4mini2::*NumberHandler)(double values[], char *names[], int n);
+    typedef bool (IndiAstroLink4mini2::*SwitchHandler)(ISState *states, char *names[], int n);
+    typedef bool (IndiAstroLink4mini2::*TextHandler)(char *texts[], char *names[], int n);
+    enum RefreshGroup
+    {
+        REFRESH_NONE,
+        REFRESH_TELEMETRY,
+        REFRESH_SETTINGS
+    };
+    struct PropertyEntry
+    {
+        INumberVectorProperty *number;
+        ISwitchVectorProperty *switches;
+        ILightVectorProperty *lights;
+        ITextVectorProperty *text;
+        NumberHandler onNumber;
+        SwitchHandler onSwitch;
+        TextHandler onText;
+        bool persist;
+        RefreshGroup refresh;
+        // SensorFlags the property depends on, 0 when it is always defined
+        unsigned sensor;
+        const char *name() const;
+        const char *tab() const;
+        IPState state() const;
+    };
+    std::vector<PropertyEntry> properties;
+    std::unordered_map<std::string_view, size_t> propertyIndex;
+    void registerProperty(INumberVectorProperty *nvp, NumberHandler handler, bool persist, RefreshGroup refresh, unsigned sensor = 0);
+    void registerProperty(ISwitchVectorProperty *svp, SwitchHandler handler, bool persist, RefreshGroup refresh);
+    void registerProperty(ILightVectorProperty *lvp, RefreshGroup refresh);
+    void registerProperty(ITextVectorProperty *tvp, TextHandler handler, bool persist, RefreshGroup refresh);
+    const PropertyEntry *findProperty(const char *name) const;
+    void defineEntry(const PropertyEntry &entry);
+    bool entryDefined(const PropertyEntry &entry) const
+    {
+        return entry.sensor == 0 || hasSensor(entry.sensor);
+    }
+    bool refreshPending(RefreshGroup refresh) const;
+
+    // Updates made during a poll tick are sent together when the tick ends.
+    // A property set more than once in the tick goes out once, with its last
+    // values. Outside of a tick updates are sent right away.
+    struct PendingSet
+    {
+        INumberVectorProperty *number;
+        ISwitchVectorProperty *switches;
+        ITextVectorProperty *text;
+        ILightVectorProperty *lights;
+        INDI::Property *property;
+    };
+    void queueSet(INumberVectorProperty *nvp);
+    void queueSet(ISwitchVectorProperty *svp);
+    void queueSet(ITextVectorProperty *tvp);
+    void queueSet(ILightVectorProperty *lvp);
+    void queueSet(INDI::Property &property);
+    void queuePending(const PendingSet &set);
+    void flushProperties();
+    std::vector<PendingSet> pendingSets;
+    bool batchingSets = false;
+
+    // Property handlers
+    bool handlePWM(double values[], char *names[], int n);
+    bool handleSQMOffset(double values[], char *names[], int n);
+    template <int F> bool handleFocuserSettings(double values[], char *names[], int n);
+    bool handlePower1(ISState *states, char *names[], int n);
+    bool handlePower2(ISState *states, char *names[], int n);
+    bool handlePower3(ISState *states, char *names[], int n);
+    bool setPowerOutput(int output, ISwitchVectorProperty *svp, ISState *states, char *names[], int n);
+    bool handlePowerDefaultOn(ISState *states, char *names[], int n);
+    bool handlePowerTransaction(double values[], char *names[], int n);
+    bool handlePowerTransactionPorts(ISState *states, char *names[], int n);
+    void seedPowerTransaction();
+    void startPowerTransaction();
+    bool finishPowerTransaction(const char *cmds[], char *res[], int count);
+    void staggerPort();
+    static void staggerHelper(void *context);
+    template <int F> bool handleFocuserMode(ISState *states, char *names[], int n);
+    bool handleFocuserSelect(ISState *states, char *names[], int n);
+    bool handleMotionTracking(ISState *states, char *names[], int n);
+    bool handleWeatherSafety(double values[], char *names[], int n);
+    bool handleMotionLogPath(char *texts[], char *names[], int n);
+    std::string motionLogPath() const;
+    bool handleMotionLog(ISState *states, char *names[], int n);
+
+    // Focuser presets, applied to the selected focuser with a single 'U' write
+    struct FocuserPreset
+    {
+        std::string name;
+        double settings[FS_COUNT];
+        int mode;
+        double maxPosition;
+        bool reverse;
+    };
+    std::vector<FocuserPreset> presets;
+    bool handlePresetName(char *texts[], char *names[], int n);
+    bool handlePresetAction(ISState *states, char *names[], int n);
+    bool handlePresets(char *texts[], char *names[], int n);
+    bool parsePresets(const char *text, std::vector<FocuserPreset> &parsed);
+    void publishPresets(IPState state = IPS_OK);
+    bool applyPreset(const FocuserPreset &preset);
+
+    // Backlash compensation
+    bool startMove(uint32_t targetTicks);
+    int32_t backlashSteps = 0;
+    bool backlashEnabled = false;
+    int approachDirection[2] = {0, 0};
+    bool backlashPending = false;
+    uint32_t backlashTarget = 0;
+
+    // Protection events
+    bool handleProtectionSettings(double values[], char *names[], int n);
+    bool handleProtectionPolling(ISState *states, char *names[], int n);
+    void updateProtection(int type, const std::string &value);
+    int protectionType = 0;
+
+    // Decoded device state. The 'q' reply is decoded into the back buffer,
+    // which becomes current only after the whole frame was parsed.
+    struct DeviceState
+    {
+        uint64_t sequence;
+        double timestamp;
+        double wallTime;
+        bool extended;
+        int position[2];
+        int stepsToGo[2];
+        double current;
+        unsigned sensors;
+        double sens1Temp, sens1Hum, sens1Dew;
+        double sens2Temp;
+        double sens2eTemp, sens2eHum, sens2eDew;
+        double pwm[2];
+        bool output[3];
+        double vin, vreg, ah, wh;
+        int overType;
+        char overValue[16];
+        double mlxTemp, mlxAux;
+        double sbm;
+    };
+    DeviceState deviceStates[2] {};
+    int activeState = 0;
+    bool stateStale = true;
+    const DeviceState &deviceState() const
+    {
+        return deviceStates[activeState];
+    }
+    const DeviceState &freshState();
+    bool queryStatus();
+    bool commitStatus(const char *res, double timestamp, double wallTime);
+    bool sendBatch(const char *const cmds[], char *const res[], int count);
+    bool decodeStatus(const char *res, DeviceState &state);
+    double lastFullStatus = 0;
+
+    // Motion tracking: while the selected focuser moves, the short 'p' and
+    // 'i' queries are polled at a high rate in place of the full status
+    // frame, which is still read at the normal telemetry cadence
+    bool motionTracking();
+    bool queryMotion();
+    void publishFocuser(const DeviceState &state);
+    bool moving = false;
+    bool motionQuerySupported = true;
+    uint64_t motionQueries = 0;
+    int focuserTarget();
+    void publishOutputs(const DeviceState &state, bool switches);
+    int moveTarget[2] = {0, 0};
+
+    // Focus sweep, a whole V-curve run executed by the driver
+    bool handleFocusSweep(double values[], char *names[], int n);
+    bool handleFocusSweepControl(ISState *states, char *names[], int n);
+    bool startSweepMove(int target);
+    void stopFocusSweep(IPState state);
+    struct FocusSweep
+    {
+        bool active;
+        int focuser;
+        int point;
+        int count;
+        int start;
+        int step;
+        double dwell;
+        bool approaching;
+        bool settled;
+        bool advance;
+        double reachedAt;
+    };
+    FocusSweep focusSweep {};
+    void runFocusSweep(const DeviceState &state);
+
+    // Link circuit breaker. Consecutive failures open it, then only a probe
+    // with a short timeout is sent, with exponential backoff between probes.
+    enum LinkState
+    {
+        LINK_UP,
+        LINK_DOWN
+    };
+    LinkState linkState = LINK_UP;
+    int linkFailures = 0;
+    int linkError = 0;
+    uint32_t linkTrips = 0;
+    uint32_t linkReconnects = 0;
+    double linkBackoff = 0;
+    double nextProbe = 0;
+    bool probing = false;
+    bool reconnecting = false;
+    bool linkAvailable();
+    int commandTimeout() const;
+    void recordLinkResult(int tty_rc);
+    void openBreaker();
+    void probeLink();
+    bool reopenConnection();
+    void linkRestored();
+    void publishLinkHealth();
+
+    // Hot plug: the /dev/serial/by-id link of the adapter is watched. Removal
+    // opens the breaker at once and probes wait until the link is back, then
+    // the port is reopened through the link, whatever tty it points to now.
+    bool handleHotplug(ISState *states, char *names[], int n);
+    void startHotplug();
+    void onPortChange(bool present);
+    PortWatcher portWatcher{[this](bool present) { onPortChange(present); }};
+    bool portRemoved = false;
+
+    // Poll scheduling
+    void startPolling();
+    uint32_t pollPeriod();
+    int pollTimer = -1;
+    double pollDeadline = 0;
+    double lastTick = 0;
+    uint32_t pollOverruns = 0;
+    double pollStatsPublished = 0;
+    SlidingWindowStats pollJitter{60};
+    SlidingWindowStats pollInterval{60};
+    SlidingWindowStats pollLatency{60};
+
+    // Focuser motion profile
+    FocuserMotionProfiler motionProfiler;
+    void updateMotionProfile();
+
+    // Metrics exporter, scrapes are served from the decoded state only
+    bool handleMetrics(ISState *states, char *names[], int n);
+    bool handleMetricsEndpoint(char *texts[], char *names[], int n);
+    void startMetrics();
+    void renderMetrics(std::string &out);
+    MetricsExporter metricsExporter{[this](std::string &out) { renderMetrics(out); }};
+    uint64_t commandErrors = 0;
+    uint64_t frameErrors = 0;
+
+    // Weather statistics
+    void addWeatherSample(int parameter, double timestamp, double value);
+
+    // Camera guard: CCD_EXPOSURE of a camera sharing the USB hub is snooped.
+    // Polling is thinned or paused while the image is read out, settings
+    // writes and the backlash return leg wait for the end of the exposure.
+    bool handleCameraGuard(char *texts[], char *names[], int n);
+    bool handleCameraGuardMode(ISState *states, char *names[], int n);
+    bool handleCameraGuardSettings(double values[], char *names[], int n);
+    bool exposureActive() const;
+    bool readoutActive() const;
+    bool guardSkipsPoll(double now);
+    void flushDeferredSettings();
+    void publishCameraGuard();
+    SettingsUpdate deferredSettings;
+    bool exposureBusy = false;
+    double exposureRemaining = 0;
+    double exposureSeen = 0;
+    double lastGuardedPoll = 0;
+    bool backlashHeld = false;
+    uint64_t guardSkipped = 0;
+    uint64_t guardDeferred = 0;
+    uint64_t guardHeld = 0;
+
+    // Sensors attached to the controller, discovered at connect from the
+    // presence flags of the status frame. Only the publishers of present
+    // sensors run on each poll, discovery runs again when a flag changes.
+    enum SensorFlags
+    {
+        SENSOR_SENS1 = 1,
+        SENSOR_SENS2 = 2,
+        SENSOR_SENS2E = 4,
+        SENSOR_MLX = 8,
+        SENSOR_SBM = 16
+    };
+    typedef void (IndiAstroLink4mini2::*SensorPublisher)(const DeviceState &state, double now);
+    void discoverSensors(unsigned found);
+    void publishSens1(const DeviceState &state, double now);
+    void publishSens2(const DeviceState &state, double now);
+    void publishSens2E(const DeviceState &state, double now);
+    void publishSky(const DeviceState &state, double now);
+    void publishSBM(const DeviceState &state, double now);
+    std::vector<SensorPublisher> sensorPublishers;
+    unsigned sensors = 0;
+    bool sensorsKnown = false;
+    bool hasSensor(unsigned flag) const
+    {
+        return sensorsKnown && (sensors & flag);
+    }
 
     ISwitch FocuserSelectS[2];
     ISwitchVectorProperty FocuserSelectSP;
+    ISwitch MotionTrackS[2];
+    ISwitchVectorProperty MotionTrackSP;
+    enum
+    {
+        MOTION_TRACK_ENABLE,
+        MOTION_TRACK_DISABLE
+    };
 
     INumber Focuser1SettingsN[6];
     INumberVectorProperty Focuser1SettingsNP;
@@ -226,6 +467,216 @@ private:
 
     INumber SQMOffsetN[1];
     INumberVectorProperty SQMOffsetNP;
+
+    INumber WeatherSafetyN[5];
+    INumberVectorProperty WeatherSafetyNP;
+    enum
+    {
+        WS_WINDOW,
+        WS_CLOUDY,
+        WS_CLEAR,
+        WS_DEW_UNSAFE,
+        WS_DEW_SAFE
+    };
+
+    enum
+    {
+        WSTAT_TEMPERATURE,
+        WSTAT_HUMIDITY,
+        WSTAT_DEW_MARGIN,
+        WSTAT_SKY_DIFF,
+        WSTAT_COUNT
+    };
+    enum
+    {
+        STAT_MIN,
+        STAT_MAX,
+        STAT_MEAN,
+        STAT_STDDEV,
+        STAT_RATE,
+        STAT_COUNT
+    };
+    INumber WeatherStatsN[WSTAT_COUNT * STAT_COUNT];
+    INumberVectorProperty WeatherStatsNP;
+    SlidingWindowStats weatherStats[WSTAT_COUNT];
+
+    INumber PollStatsN[7];
+    INumberVectorProperty PollStatsNP;
+    enum
+    {
+        POLL_SAMPLE_TIME,
+        POLL_RATE,
+        POLL_JITTER_MEAN,
+        POLL_JITTER_MAX,
+        POLL_OVERRUNS,
+        POLL_LATENCY_MEAN,
+        POLL_LATENCY_MAX
+    };
+
+    INumber LinkHealthN[4];
+    INumberVectorProperty LinkHealthNP;
+    ISwitch HotplugS[2];
+    ISwitchVectorProperty HotplugSP;
+    enum
+    {
+        HOTPLUG_ENABLE,
+        HOTPLUG_DISABLE
+    };
+    IText HotplugT[1] {};
+    ITextVectorProperty HotplugTP;
+    enum
+    {
+        LINK_FAILURES,
+        LINK_TRIPS,
+        LINK_RECONNECTS,
+        LINK_RETRY
+    };
+
+    IText CameraGuardT[1] {};
+    ITextVectorProperty CameraGuardTP;
+    ISwitch CameraGuardModeS[3];
+    ISwitchVectorProperty CameraGuardModeSP;
+    enum
+    {
+        GUARD_OFF,
+        GUARD_THIN,
+        GUARD_PAUSE
+    };
+    INumber CameraGuardN[2];
+    INumberVectorProperty CameraGuardNP;
+    enum
+    {
+        GUARD_THIN_PERIOD,
+        GUARD_READOUT
+    };
+    INumber CameraGuardStatusN[4];
+    INumberVectorProperty CameraGuardStatusNP;
+    enum
+    {
+        GUARD_EXPOSING,
+        GUARD_SKIPPED,
+        GUARD_DEFERRED,
+        GUARD_HELD
+    };
+
+    IText FirmwareT[2] {};
+    ITextVectorProperty FirmwareTP;
+    enum
+    {
+        FW_VERSION,
+        FW_SENSORS
+    };
+    INumber Sensor2N[1];
+    INumberVectorProperty Sensor2NP;
+    INumber Sensor2EN[3];
+    INumberVectorProperty Sensor2ENP;
+    enum
+    {
+        SENS2E_TEMP,
+        SENS2E_HUM,
+        SENS2E_DEW
+    };
+
+    INumber MotionProfileN[8];
+    INumberVectorProperty MotionProfileNP;
+    enum
+    {
+        MP_MOVES,
+        MP_AVG_PPS,
+        MP_PEAK_PPS,
+        MP_AVG_DURATION,
+        MP_MAX_OVERSHOOT,
+        MP_LAST_PPS,
+        MP_LAST_DURATION,
+        MP_LAST_OVERHEAD
+    };
+    IText MotionLogPathT[1] {};
+    ITextVectorProperty MotionLogPathTP;
+    ISwitch MotionLogS[2];
+    ISwitchVectorProperty MotionLogSP;
+    enum
+    {
+        MP_LOG_EXPORT,
+        MP_LOG_CLEAR
+    };
+
+    INumber FocusSweepN[5];
+    INumberVectorProperty FocusSweepNP;
+    enum
+    {
+        SWEEP_START,
+        SWEEP_STEP,
+        SWEEP_COUNT,
+        SWEEP_APPROACH,
+        SWEEP_DWELL
+    };
+    ISwitch FocusSweepControlS[2];
+    ISwitchVectorProperty FocusSweepControlSP;
+    enum
+    {
+        SWEEP_NEXT,
+        SWEEP_ABORT
+    };
+    IText FocusSweepPointT[3] {};
+    ITextVectorProperty FocusSweepPointTP;
+    enum
+    {
+        SWEEP_POINT_INDEX,
+        SWEEP_POINT_POSITION,
+        SWEEP_POINT_TIME
+    };
+
+    IText MetricsEndpointT[1] {};
+    ITextVectorProperty MetricsEndpointTP;
+    ISwitch MetricsS[2];
+    ISwitchVectorProperty MetricsSP;
+    enum
+    {
+        METRICS_ENABLE,
+        METRICS_DISABLE
+    };
+
+    ILight ProtectionL[2];
+    ILightVectorProperty ProtectionLP;
+    enum
+    {
+        PROT_VOLTAGE,
+        PROT_CURRENT
+    };
+    IText ProtectionEventT[3] {};
+    ITextVectorProperty ProtectionEventTP;
+    enum
+    {
+        PROT_EVENT_TYPE,
+        PROT_EVENT_VALUE,
+        PROT_EVENT_TIME
+    };
+    INumber ProtectionSettingsN[3];
+    INumberVectorProperty ProtectionSettingsNP;
+    enum
+    {
+        PROT_OVERVOLTAGE,
+        PROT_OVERCURRENT,
+        PROT_OVERTIME
+    };
+    ISwitch ProtectionPollS[2];
+    ISwitchVectorProperty ProtectionPollSP;
+    enum
+    {
+        PROT_POLL_FAST,
+        PROT_POLL_NORMAL
+    };
+
+    ILight SafetyStatusL[2];
+    ILightVectorProperty SafetyStatusLP;
+    enum
+    {
+        SAFETY_CLOUD,
+        SAFETY_DEW
+    };
+    // cloudy when the sky gets warmer, dew risk when the margin shrinks
+    HysteresisFlag cloudFlag{HysteresisFlag::RISING};
+    HysteresisFlag dewFlag{HysteresisFlag::FALLING};
         
     ISwitch Power1S[2];
     ISwitchVectorProperty Power1SP;
@@ -235,6 +686,34 @@ private:
     ISwitchVectorProperty Power3SP;
     INumber PWMN[2];
     INumberVectorProperty PWMNP;
+    IText PresetNameT[1] {};
+    ITextVectorProperty PresetNameTP;
+    ISwitch PresetActionS[3];
+    ISwitchVectorProperty PresetActionSP;
+    enum
+    {
+        PRESET_SAVE,
+        PRESET_APPLY,
+        PRESET_DELETE
+    };
+    IText PresetsT[1] {};
+    ITextVectorProperty PresetsTP;
+
+    INumber PowerTransactionN[3];
+    INumberVectorProperty PowerTransactionNP;
+    enum
+    {
+        PT_PWM1,
+        PT_PWM2,
+        PT_STAGGER
+    };
+    ISwitch PowerTransactionS[3];
+    ISwitchVectorProperty PowerTransactionSP;
+    // ports still to be switched on by the stagger timer
+    int staggerPorts[3] {};
+    int staggerCount = 0;
+    int staggerNext = 0;
+    int staggerTimer = -1;
     ISwitch PowerDefaultOnS[3];
     ISwitchVectorProperty PowerDefaultOnSP;
 
@@ -243,6 +722,7 @@ private:
     static constexpr const char *SETTINGS_TAB{"Settings"};
     static constexpr const char *FOC2_SETTINGS_TAB{"Focuser 2 Settings"};
     static constexpr const char *FOC1_SETTINGS_TAB{"Focuser 1 Settings"};
+    static constexpr const char *DIAGNOSTICS_TAB{"Diagnostics"};
 };
 
 #endif